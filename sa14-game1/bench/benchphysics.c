@@ -0,0 +1,264 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/common.h"
+#include "base/jobs.h"
+#include "base/time.h"
+#include "physics/physics.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// Same time step as the physics subsystem.
+#define TimeStep (1.0f/120.0f)
+
+// Same body size as the physics component.
+#define BodySize (0.3f)
+
+// Bodies are spawned at the same density whatever their number, so that the
+// timings of different body counts are for the same kind of scene. This many
+// bodies get the spawn area below, which is a bit smaller than the world, and
+// both are scaled by the square root of the body count from there.
+#define ReferenceBodies (500)
+#define SpawnHalfWidth  (6.5f)
+#define SpawnHalfHeight (4.5f)
+#define BoundsMargin    (0.5f)
+
+#define MaxSpeed (2.0f)
+
+#define MaxRuns 16
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct {
+    int  body_counts[MaxRuns];
+    int  num_runs;
+    int  steps;
+    int  warmup_steps;
+    int  threads; // Zero to run on the calling thread, negative for auto.
+    int  seed;
+    bool sap;
+    bool ccd;
+} benchOptionsT;
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static float randomFloat(uint32_t* seed, float min_value, float max_value) {
+    // We don't use rand() since its sequence differs between C libraries, and
+    // the same seed should give the same scene everywhere.
+    *seed = *seed * 1664525u + 1013904223u;
+
+    float x = (*seed >> 8) / (float)(1 << 24);
+
+    return (min_value + x*(max_value-min_value));
+}
+
+static void printUsage(const string* program) {
+    printf("usage: %s [--bodies=N[,N...]] [--steps=N] [--warmup=N]\n"
+           "       [--threads=N] [--seed=N] [--broadphase=hash|sap]\n"
+           "       [--ccd=0|1]\n\n"
+           "Prints one line of key=value pairs per body count. hash is the\n"
+           "final world state, which should match between builds. The world\n"
+           "grows with the body count, so the density stays the same.\n"
+           "--threads=0 runs on the calling thread, -1 uses all processors.\n",
+           program);
+}
+
+static bool parseOptions(int argc, char** argv, benchOptionsT* opts) {
+    opts->body_counts[0] = 500;
+    opts->num_runs       = 1;
+    opts->steps          = 1000;
+    opts->warmup_steps   = 60;
+    opts->threads        = 0;
+    opts->seed           = 1;
+    opts->sap            = false;
+    opts->ccd            = false;
+
+    for (int i = 1; i < argc; i++) {
+        const string* arg = argv[i];
+        const string* val = strchr(arg, '=');
+
+        if (!val) {
+            printUsage(argv[0]);
+            return (false);
+        }
+
+        val++;
+
+        if (strncmp(arg, "--bodies=", 9) == 0) {
+            opts->num_runs = 0;
+
+            while (*val && opts->num_runs < MaxRuns) {
+                string* end;
+                int     n = strtol(val, &end, 10);
+
+                if (end == val)
+                    break;
+
+                opts->body_counts[opts->num_runs++] = n;
+                val = (*end == ',') ? end+1 : end;
+            }
+        }
+        else if (strncmp(arg, "--steps=", 8) == 0) {
+            opts->steps = atoi(val);
+        }
+        else if (strncmp(arg, "--warmup=", 9) == 0) {
+            opts->warmup_steps = atoi(val);
+        }
+        else if (strncmp(arg, "--threads=", 10) == 0) {
+            opts->threads = atoi(val);
+        }
+        else if (strncmp(arg, "--seed=", 7) == 0) {
+            opts->seed = atoi(val);
+        }
+        else if (strncmp(arg, "--broadphase=", 13) == 0) {
+            opts->sap = (strcmp(val, "sap") == 0);
+        }
+        else if (strncmp(arg, "--ccd=", 6) == 0) {
+            opts->ccd = (atoi(val) != 0);
+        }
+        else {
+            printUsage(argv[0]);
+            return (false);
+        }
+    }
+
+    return (opts->num_runs > 0 && opts->steps > 0);
+}
+
+static void runBenchmark(const benchOptionsT* opts, int num_bodies,
+                         jobSystemT* jobs)
+{
+    worldT*  world  = worldNew();
+    bodyT**  bodies = malloc(num_bodies * sizeof(bodyT*));
+    uint32_t seed   = (uint32_t)opts->seed;
+
+    float scale       = sqrtf(max(num_bodies, 1) / (float)ReferenceBodies);
+    float half_width  = SpawnHalfWidth  * scale;
+    float half_height = SpawnHalfHeight * scale;
+
+    aabbT bounds = {
+        { .x = -(half_width+BoundsMargin), .y = -(half_height+BoundsMargin) },
+        { .x =   half_width+BoundsMargin , .y =   half_height+BoundsMargin  }
+    };
+
+    worldSetBounds(world, bounds, SolidBounds);
+    worldSetBroadphase(world, opts->sap ? SweepAndPruneBroadphase
+                                        : SpatialHashBroadphase);
+    worldSetJobSystem(world, jobs);
+
+    for (int i = 0; i < num_bodies; i++) {
+        bodyT* body = bodyNewSquare(BodySize, BodySize, 1.0f);
+
+        // One call per statement, since the order in which initializers are
+        // evaluated is unspecified and the seed has to advance the same way
+        // in every build.
+        vec2 pos, vel;
+
+        pos.x = randomFloat(&seed, -half_width , half_width );
+        pos.y = randomFloat(&seed, -half_height, half_height);
+        vel.x = randomFloat(&seed, -MaxSpeed, MaxSpeed);
+        vel.y = randomFloat(&seed, -MaxSpeed, MaxSpeed);
+
+        bodySetPosition   (body, pos);
+        bodySetOrientation(body, randomFloat(&seed, 0.0f, 2.0f*3.1415926f));
+        bodySetVelocity   (body, vel);
+        bodySetCCD        (body, opts->ccd);
+
+        worldAddBody(world, body);
+        bodies[i] = body;
+    }
+
+    for (int i = 0; i < opts->warmup_steps; i++)
+        worldStep(world, TimeStep);
+
+    // The pair counts are summed over all steps so that we can report both
+    // the average and the peak.
+    long long pair_sum      = 0;
+    long long collision_sum = 0;
+    long long contact_sum   = 0;
+    long long awake_sum     = 0;
+    int       max_pairs     = 0;
+
+    long long us = 0;
+
+    for (int i = 0; i < opts->steps; i++) {
+        timeT start = getTime();
+        worldStep(world, TimeStep);
+        us += elapsedMicrosecsSince(start);
+
+        worldStatsT stats;
+        worldGetStats(world, &stats);
+
+        pair_sum      += stats.num_pairs;
+        collision_sum += stats.num_collisions;
+        contact_sum   += stats.num_contacts;
+        awake_sum     += stats.num_awake;
+        max_pairs      = max(max_pairs, stats.num_pairs);
+    }
+
+    double secs  = us / 1000000.0;
+    double steps = opts->steps;
+
+    printf("bodies=%d steps=%d threads=%d broadphase=%s ccd=%d seed=%d "
+           "world=%.2fx%.2f secs=%.6f "
+           "steps_per_sec=%.2f ns_per_body_step=%.2f avg_awake=%.2f "
+           "avg_pairs=%.2f max_pairs=%d avg_collisions=%.2f "
+           "avg_contacts=%.2f hash=%08x\n",
+           num_bodies, opts->steps, jobs ? jobSystemNumThreads(jobs) : 0,
+           opts->sap ? "sap" : "hash", opts->ccd, opts->seed,
+           bounds.max.x-bounds.min.x, bounds.max.y-bounds.min.y, secs,
+           (secs > 0.0) ? steps/secs : 0.0,
+           (num_bodies > 0) ? us*1000.0/(steps*num_bodies) : 0.0,
+           awake_sum/steps, pair_sum/steps, max_pairs, collision_sum/steps,
+           contact_sum/steps, (unsigned int)worldStateHash(world));
+
+    fflush(stdout);
+
+    worldFree(world);
+
+    for (int i = 0; i < num_bodies; i++)
+        bodyFree(bodies[i]);
+
+    free(bodies);
+}
+
+/*--------------------------------------
+ * Function: main()
+ *
+ * Description:
+ *   Headless physics benchmark entry point. Steps a world full of randomly
+ *   moving square bodies and prints timings and pair counts.
+ *
+ * Usage:
+ *   bench-physics --bodies=100,1000 --steps=1000 --seed=1
+ *------------------------------------*/
+int main(int argc, char** argv) {
+    benchOptionsT opts;
+
+    if (!parseOptions(argc, argv, &opts))
+        return (EXIT_FAILURE);
+
+    jobSystemT* jobs = NULL;
+    if (opts.threads != 0)
+        jobs = jobSystemNew(max(opts.threads, 0));
+
+    for (int i = 0; i < opts.num_runs; i++)
+        runBenchmark(&opts, opts.body_counts[i], jobs);
+
+    jobSystemFree(jobs);
+
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,114 @@
+#ifdef __linux__
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/common.h"
+#include "base/debug.h"
+#include "base/thread.h"
+
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#include <sys/sysinfo.h>
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+struct threadT {
+    pthread_t thread;
+    threadFnT fn;
+    void*     arg;
+};
+
+struct mutexT {
+    pthread_mutex_t mutex;
+};
+
+struct condT {
+    pthread_cond_t cond;
+};
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static void* threadMain(void* arg) {
+    threadT* thread = arg;
+
+    thread->fn(thread->arg);
+
+    return (NULL);
+}
+
+threadT* threadNew(threadFnT fn, void* arg) {
+    threadT* thread = malloc(sizeof(threadT));
+
+    thread->fn  = fn;
+    thread->arg = arg;
+
+    if (pthread_create(&thread->thread, NULL, threadMain, thread) != 0)
+        error("could not create thread");
+
+    return (thread);
+}
+
+void threadJoin(threadT* thread) {
+    pthread_join(thread->thread, NULL);
+    free(thread);
+}
+
+int numProcessors(void) {
+    return (max(get_nprocs(), 1));
+}
+
+mutexT* mutexNew(void) {
+    mutexT* mutex = malloc(sizeof(mutexT));
+
+    pthread_mutex_init(&mutex->mutex, NULL);
+
+    return (mutex);
+}
+
+void mutexFree(mutexT* mutex) {
+    pthread_mutex_destroy(&mutex->mutex);
+    free(mutex);
+}
+
+void mutexLock(mutexT* mutex) {
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+void mutexUnlock(mutexT* mutex) {
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+condT* condNew(void) {
+    condT* cond = malloc(sizeof(condT));
+
+    pthread_cond_init(&cond->cond, NULL);
+
+    return (cond);
+}
+
+void condFree(condT* cond) {
+    pthread_cond_destroy(&cond->cond);
+    free(cond);
+}
+
+void condWait(condT* cond, mutexT* mutex) {
+    pthread_cond_wait(&cond->cond, &mutex->mutex);
+}
+
+void condSignal(condT* cond) {
+    pthread_cond_signal(&cond->cond);
+}
+
+void condBroadcast(condT* cond) {
+    pthread_cond_broadcast(&cond->cond);
+}
+
+#endif // __linux__
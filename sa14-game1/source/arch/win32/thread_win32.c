@@ -0,0 +1,117 @@
+#ifdef WIN32
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/common.h"
+#include "base/debug.h"
+#include "base/thread.h"
+
+#include <stdlib.h>
+
+#include <windows.h>
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+struct threadT {
+    HANDLE    thread;
+    threadFnT fn;
+    void*     arg;
+};
+
+struct mutexT {
+    CRITICAL_SECTION cs;
+};
+
+struct condT {
+    CONDITION_VARIABLE cv;
+};
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static DWORD WINAPI threadMain(LPVOID arg) {
+    threadT* thread = arg;
+
+    thread->fn(thread->arg);
+
+    return (0);
+}
+
+threadT* threadNew(threadFnT fn, void* arg) {
+    threadT* thread = malloc(sizeof(threadT));
+
+    thread->fn     = fn;
+    thread->arg    = arg;
+    thread->thread = CreateThread(NULL, 0, threadMain, thread, 0, NULL);
+
+    if (!thread->thread)
+        error("could not create thread");
+
+    return (thread);
+}
+
+void threadJoin(threadT* thread) {
+    WaitForSingleObject(thread->thread, INFINITE);
+    CloseHandle(thread->thread);
+    free(thread);
+}
+
+int numProcessors(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    return (max((int)info.dwNumberOfProcessors, 1));
+}
+
+mutexT* mutexNew(void) {
+    mutexT* mutex = malloc(sizeof(mutexT));
+
+    InitializeCriticalSection(&mutex->cs);
+
+    return (mutex);
+}
+
+void mutexFree(mutexT* mutex) {
+    DeleteCriticalSection(&mutex->cs);
+    free(mutex);
+}
+
+void mutexLock(mutexT* mutex) {
+    EnterCriticalSection(&mutex->cs);
+}
+
+void mutexUnlock(mutexT* mutex) {
+    LeaveCriticalSection(&mutex->cs);
+}
+
+condT* condNew(void) {
+    condT* cond = malloc(sizeof(condT));
+
+    InitializeConditionVariable(&cond->cv);
+
+    return (cond);
+}
+
+void condFree(condT* cond) {
+    // Condition variables don't need to be deleted on Windows.
+    free(cond);
+}
+
+void condWait(condT* cond, mutexT* mutex) {
+    SleepConditionVariableCS(&cond->cv, &mutex->cs, INFINITE);
+}
+
+void condSignal(condT* cond) {
+    WakeConditionVariable(&cond->cv);
+}
+
+void condBroadcast(condT* cond) {
+    WakeAllConditionVariable(&cond->cv);
+}
+
+#endif // WIN32
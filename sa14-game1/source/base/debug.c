@@ -16,13 +16,17 @@
 #include "debug.h"
 
 #include "base/common.h"
-#include "graphics/graphics.h"
 
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+// Headless builds (like the physics benchmark) don't link the graphics code.
+#ifndef HEADLESS
+#include "graphics/graphics.h"
+
 #include <GL/glew.h>
+#endif // !HEADLESS
 
 #ifdef _WIN32
 #include <windows.h>
@@ -32,6 +36,7 @@
  * FUNCTIONS
  *----------------------------------------------*/
 
+#ifndef HEADLESS
 static void printLastErrorGL(void) {
     GLenum error = glGetError();
 
@@ -48,6 +53,7 @@ static void printLastErrorGL(void) {
 
     printf("\n\n");
 }
+#endif // !HEADLESS
 
 #ifdef _WIN32
 static void printLastErrorWin32(void) {
@@ -125,7 +131,10 @@ void errorFunc(const string* msg, const string* func_name, int line, ...) {
 #ifdef _WIN32
     ShowWindow(GetConsoleWindow(), SW_SHOW);
 #endif // _WIN32
+
+#ifndef HEADLESS
     hideWindow();
+#endif // !HEADLESS
 
     string s[1024];
     va_start(ap, line);
@@ -138,7 +147,9 @@ void errorFunc(const string* msg, const string* func_name, int line, ...) {
     setTextColor(NULL);
     printf("This program will now exit.\n");
 
+#ifndef HEADLESS
     printLastErrorGL();
+#endif // !HEADLESS
 
 #ifdef _WIN32
     printLastErrorWin32();
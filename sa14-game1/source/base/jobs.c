@@ -0,0 +1,279 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "jobs.h"
+
+#include "base/common.h"
+#include "base/debug.h"
+#include "base/thread.h"
+
+#include <stdlib.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// The initial capacity of each job queue. Must be a power of two.
+#define InitialQueueCapacity (64)
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct {
+    jobFnT fn;
+    void*  data;
+    int    begin;
+    int    end;
+} jobT;
+
+// Each thread has its own double-ended job queue. The owner pushes and pops
+// jobs at the bottom, while other threads that run out of work steal from the
+// top. That way, threads mostly stay out of each other's way.
+typedef struct {
+    mutexT* lock;
+    jobT*   jobs; // Ring buffer.
+    int     top;
+    int     bottom;
+    int     max_jobs;
+} jobQueueT;
+
+typedef struct {
+    jobSystemT* jobs;
+    int         index; // The index of the thread's own queue.
+} workerT;
+
+struct jobSystemT {
+    threadT** threads;
+    workerT*  workers;
+    int       num_threads;
+
+    // One queue per worker thread, plus one (the last one) for the thread
+    // calling jobsParallelFor().
+    jobQueueT* queues;
+    int        num_queues;
+
+    mutexT* lock;
+    condT*  work_cond;   // Signaled when jobs are queued or on quit.
+    condT*  done_cond;   // Signaled when the last pending job is finished.
+    int     num_queued;  // Jobs waiting in the queues.
+    int     num_pending; // Jobs that haven't finished yet.
+    bool    quit;
+};
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static void queuePush(jobQueueT* queue, const jobT* job) {
+    mutexLock(queue->lock);
+
+    if (queue->bottom - queue->top == queue->max_jobs) {
+        int   max_jobs = queue->max_jobs * 2;
+        jobT* jobs     = malloc(max_jobs * sizeof(jobT));
+
+        for (int i = queue->top; i < queue->bottom; i++)
+            jobs[i & (max_jobs-1)] = queue->jobs[i & (queue->max_jobs-1)];
+
+        free(queue->jobs);
+        queue->jobs     = jobs;
+        queue->max_jobs = max_jobs;
+    }
+
+    queue->jobs[queue->bottom++ & (queue->max_jobs-1)] = *job;
+
+    mutexUnlock(queue->lock);
+}
+
+static bool queuePop(jobQueueT* queue, jobT* job) {
+    bool found = false;
+
+    mutexLock(queue->lock);
+
+    if (queue->bottom > queue->top) {
+        *job  = queue->jobs[--queue->bottom & (queue->max_jobs-1)];
+        found = true;
+    }
+
+    mutexUnlock(queue->lock);
+
+    return (found);
+}
+
+static bool queueSteal(jobQueueT* queue, jobT* job) {
+    bool found = false;
+
+    mutexLock(queue->lock);
+
+    if (queue->bottom > queue->top) {
+        *job  = queue->jobs[queue->top++ & (queue->max_jobs-1)];
+        found = true;
+    }
+
+    mutexUnlock(queue->lock);
+
+    return (found);
+}
+
+static bool takeJob(jobSystemT* jobs, int index, jobT* job) {
+    // Look in our own queue first, then try to steal from the others.
+    bool found = queuePop(&jobs->queues[index], job);
+
+    for (int i = 1; !found && i < jobs->num_queues; i++)
+        found = queueSteal(&jobs->queues[(index+i) % jobs->num_queues], job);
+
+    if (found) {
+        mutexLock(jobs->lock);
+        jobs->num_queued--;
+        mutexUnlock(jobs->lock);
+    }
+
+    return (found);
+}
+
+static void runJob(jobSystemT* jobs, const jobT* job) {
+    job->fn(job->data, job->begin, job->end);
+
+    mutexLock(jobs->lock);
+
+    if (--jobs->num_pending == 0)
+        condBroadcast(jobs->done_cond);
+
+    mutexUnlock(jobs->lock);
+}
+
+static void workerMain(void* arg) {
+    workerT*    worker = arg;
+    jobSystemT* jobs   = worker->jobs;
+
+    while (true) {
+        jobT job;
+
+        if (takeJob(jobs, worker->index, &job)) {
+            runJob(jobs, &job);
+            continue;
+        }
+
+        mutexLock(jobs->lock);
+
+        while (!jobs->quit && jobs->num_queued == 0)
+            condWait(jobs->work_cond, jobs->lock);
+
+        bool quit = jobs->quit;
+
+        mutexUnlock(jobs->lock);
+
+        if (quit)
+            break;
+    }
+}
+
+jobSystemT* jobSystemNew(int num_threads) {
+    if (num_threads <= 0)
+        num_threads = max(numProcessors()-1, 1);
+
+    jobSystemT* jobs = calloc(1, sizeof(jobSystemT));
+
+    jobs->num_threads = num_threads;
+    jobs->num_queues  = num_threads+1;
+    jobs->queues      = calloc(jobs->num_queues, sizeof(jobQueueT));
+    jobs->lock        = mutexNew();
+    jobs->work_cond   = condNew();
+    jobs->done_cond   = condNew();
+
+    for (int i = 0; i < jobs->num_queues; i++) {
+        jobQueueT* queue = &jobs->queues[i];
+
+        queue->lock     = mutexNew();
+        queue->jobs     = malloc(InitialQueueCapacity * sizeof(jobT));
+        queue->max_jobs = InitialQueueCapacity;
+    }
+
+    jobs->threads = malloc(num_threads * sizeof(threadT*));
+    jobs->workers = malloc(num_threads * sizeof(workerT));
+
+    for (int i = 0; i < num_threads; i++) {
+        jobs->workers[i] = (workerT) { jobs, i };
+        jobs->threads[i] = threadNew(workerMain, &jobs->workers[i]);
+    }
+
+    return (jobs);
+}
+
+void jobSystemFree(jobSystemT* jobs) {
+    if (!jobs)
+        return;
+
+    mutexLock(jobs->lock);
+    jobs->quit = true;
+    condBroadcast(jobs->work_cond);
+    mutexUnlock(jobs->lock);
+
+    for (int i = 0; i < jobs->num_threads; i++)
+        threadJoin(jobs->threads[i]);
+
+    for (int i = 0; i < jobs->num_queues; i++) {
+        mutexFree(jobs->queues[i].lock);
+        free(jobs->queues[i].jobs);
+    }
+
+    condFree(jobs->done_cond);
+    condFree(jobs->work_cond);
+    mutexFree(jobs->lock);
+
+    free(jobs->queues);
+    free(jobs->workers);
+    free(jobs->threads);
+    free(jobs);
+}
+
+int jobSystemNumThreads(const jobSystemT* jobs) {
+    return (jobs->num_threads);
+}
+
+void jobsParallelFor(jobSystemT* jobs, jobFnT fn, void* data, int n,
+                     int batch_size)
+{
+    assert(batch_size > 0);
+
+    if (n <= 0)
+        return;
+
+    // Not worth waking anyone up for a single batch.
+    if (n <= batch_size) {
+        fn(data, 0, n);
+        return;
+    }
+
+    int num_jobs = (n + batch_size - 1) / batch_size;
+
+    // Deal the jobs out over all queues, so the workers have something to do
+    // without stealing right away.
+    for (int i = 0; i < num_jobs; i++) {
+        int  begin = i * batch_size;
+        jobT job   = { fn, data, begin, min(begin+batch_size, n) };
+
+        queuePush(&jobs->queues[i % jobs->num_queues], &job);
+    }
+
+    mutexLock(jobs->lock);
+    jobs->num_queued  += num_jobs;
+    jobs->num_pending += num_jobs;
+    condBroadcast(jobs->work_cond);
+    mutexUnlock(jobs->lock);
+
+    // The calling thread uses the last queue.
+    int  index = jobs->num_queues-1;
+    jobT job;
+
+    while (takeJob(jobs, index, &job))
+        runJob(jobs, &job);
+
+    mutexLock(jobs->lock);
+
+    while (jobs->num_pending > 0)
+        condWait(jobs->done_cond, jobs->lock);
+
+    mutexUnlock(jobs->lock);
+}
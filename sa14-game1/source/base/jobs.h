@@ -0,0 +1,39 @@
+#ifndef jobs_h_
+#define jobs_h_
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/common.h"
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct jobSystemT jobSystemT;
+
+// A job processes the elements in [begin, end) of whatever data it is given.
+typedef void (*jobFnT)(void* data, int begin, int end);
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+// Creates a job system with the specified number of worker threads. Pass zero
+// to get one worker per logical processor, minus one for the calling thread.
+jobSystemT* jobSystemNew(int num_threads);
+void jobSystemFree(jobSystemT* jobs);
+
+int jobSystemNumThreads(const jobSystemT* jobs);
+
+// Splits [0, n) into ranges of batch_size elements (the last one may be
+// shorter) and runs fn on each of them, spread out over the worker threads.
+// The calling thread helps out and returns when all ranges are done. The
+// ranges are always the same for the same n and batch_size, no matter how
+// many threads there are, so jobs that write their results per range can be
+// merged deterministically. Must not be called from inside a job.
+void jobsParallelFor(jobSystemT* jobs, jobFnT fn, void* data, int n,
+                     int batch_size);
+
+#endif // jobs_h_
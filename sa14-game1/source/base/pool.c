@@ -0,0 +1,113 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "pool.h"
+
+#include "base/common.h"
+#include "base/debug.h"
+
+#include <stdlib.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// Blocks are aligned to this many bytes, which is enough for any type we put
+// in a pool.
+#define BlockAlignment (16)
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+// Released blocks are linked together through their first bytes.
+typedef struct freeBlockT {
+    struct freeBlockT* next;
+} freeBlockT;
+
+// Chunks are linked together so that they can be freed with the pool. The
+// blocks follow right after the chunk header.
+typedef struct chunkT {
+    struct chunkT* next;
+} chunkT;
+
+struct poolT {
+    size_t      block_size;
+    int         blocks_per_chunk;
+    chunkT*     chunks;
+    freeBlockT* free_blocks;
+};
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static size_t alignSize(size_t size) {
+    return ((size + BlockAlignment-1) & ~(size_t)(BlockAlignment-1));
+}
+
+static void addChunk(poolT* pool) {
+    size_t  header = alignSize(sizeof(chunkT));
+    chunkT* chunk  = malloc(header + pool->block_size*pool->blocks_per_chunk);
+
+    if (!chunk)
+        error("could not allocate pool chunk");
+
+    chunk->next  = pool->chunks;
+    pool->chunks = chunk;
+
+    // Push the blocks in reverse so that they are handed out in address order.
+    char* blocks = (char*)chunk + header;
+    for (int i = pool->blocks_per_chunk-1; i >= 0; i--) {
+        freeBlockT* block = (freeBlockT*)(blocks + i*pool->block_size);
+
+        block->next       = pool->free_blocks;
+        pool->free_blocks = block;
+    }
+}
+
+poolT* poolNew(size_t block_size, int blocks_per_chunk) {
+    assert(block_size > 0 && blocks_per_chunk > 0);
+
+    poolT* pool = calloc(1, sizeof(poolT));
+
+    pool->block_size       = alignSize(max(block_size, sizeof(freeBlockT)));
+    pool->blocks_per_chunk = blocks_per_chunk;
+
+    return (pool);
+}
+
+void poolFree(poolT* pool) {
+    if (!pool)
+        return;
+
+    chunkT* chunk = pool->chunks;
+    while (chunk) {
+        chunkT* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(pool);
+}
+
+void* poolAlloc(poolT* pool) {
+    if (!pool->free_blocks)
+        addChunk(pool);
+
+    freeBlockT* block = pool->free_blocks;
+    pool->free_blocks = block->next;
+
+    return (block);
+}
+
+void poolRelease(poolT* pool, void* block) {
+    if (!block)
+        return;
+
+    freeBlockT* free_block = block;
+
+    free_block->next  = pool->free_blocks;
+    pool->free_blocks = free_block;
+}
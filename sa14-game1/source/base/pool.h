@@ -0,0 +1,38 @@
+#ifndef pool_h_
+#define pool_h_
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/common.h"
+
+#include <stddef.h> // size_t
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+// A fixed-block allocator. Blocks are carved out of large chunks and kept on
+// a free list when released, so allocating and releasing blocks doesn't touch
+// the heap once the pool has grown to its working size. Not thread-safe.
+typedef struct poolT poolT;
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+// Creates a pool of blocks of the specified size. Memory is requested from
+// the heap blocks_per_chunk blocks at a time.
+poolT* poolNew(size_t block_size, int blocks_per_chunk);
+
+// Frees the pool and all blocks in it, released or not.
+void poolFree(poolT* pool);
+
+// Returns an uninitialized block.
+void* poolAlloc(poolT* pool);
+
+// Puts the block back in the pool so it can be handed out again.
+void poolRelease(poolT* pool, void* block);
+
+#endif // pool_h_
@@ -0,0 +1,48 @@
+#ifndef thread_h_
+#define thread_h_
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/common.h"
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct threadT threadT;
+typedef struct mutexT  mutexT;
+typedef struct condT   condT;
+
+typedef void (*threadFnT)(void* arg);
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+// Starts a new thread running fn(arg).
+threadT* threadNew(threadFnT fn, void* arg);
+
+// Waits for the thread to return from its thread function, then frees it.
+void threadJoin(threadT* thread);
+
+// Returns the number of logical processors in the system.
+int numProcessors(void);
+
+mutexT* mutexNew(void);
+void mutexFree(mutexT* mutex);
+void mutexLock(mutexT* mutex);
+void mutexUnlock(mutexT* mutex);
+
+condT* condNew(void);
+void condFree(condT* cond);
+
+// Unlocks the mutex and waits for the condition to be signaled, then locks the
+// mutex again before returning. Can wake up spuriously, so always check the
+// actual condition in a loop.
+void condWait(condT* cond, mutexT* mutex);
+void condSignal(condT* cond);
+void condBroadcast(condT* cond);
+
+#endif // thread_h_
@@ -7,30 +7,30 @@
 #include "base/common.h"
 #include "engine/component.h"
 #include "graphics/material.h"
+#include "graphics/trimesh.h"
 
 /*------------------------------------------------
  * FUNCTIONS
  *----------------------------------------------*/
 
-static void cleanup(gameComponentT* component, gameSubsystemT* subsystem) {
+static void cleanup(gameComponentT* component) {
     graphicsComponentDataT* gfx = component->data;
 
-    if (gfx->mesh) {
+    if (gfx->owns_mesh && gfx->mesh) {
         freeMesh(gfx->mesh);
         gfx->mesh = NULL;
     }
 }
 
 gameComponentT* newGraphicsComponent(triMeshT* mesh, materialT* material) {
-    gameComponentT*         component = newComponent("graphics");
-    graphicsComponentDataT* gfx_data  = calloc(1, sizeof(graphicsComponentDataT));
+    gameComponentT*         component = newComponent("graphics", sizeof(graphicsComponentDataT));
+    graphicsComponentDataT* gfx_data  = component->data;
 
     gfx_data->mesh     = mesh;
     gfx_data->material = material ? material : getNamedMaterial("debug");
 
     mat_identity(&gfx_data->transform);
 
-    component->data       = gfx_data;
     component->cleanup_fn = cleanup;
 
     return (component);
@@ -17,8 +17,13 @@
  * TYPES
  *----------------------------------------------*/
 
+// Graphics components only free their mesh if owns_mesh is set. Entities of
+// the same kind (like asteroids) usually share one mesh, which then belongs
+// to no component and is never freed. An entity with a mesh of its own (like
+// the player) sets owns_mesh, and the mesh goes when the component does.
 typedef struct {
     triMeshT*  mesh;             // Model mesh.
+    bool       owns_mesh;        // Free the mesh with the component.
     mat4x4     transform;        // Model transform matrix.
     materialT* material;         // Shader material.
     //shaderT*   shader;           // Shader, or NULL to use default.
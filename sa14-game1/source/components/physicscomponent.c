@@ -14,7 +14,7 @@
  * FUNCTIONS
  *----------------------------------------------*/
 
-static void cleanup(gameComponentT* component, gameSubsystemT* subsystem) {
+static void cleanup(gameComponentT* component) {
     physicsComponentDataT* phys = component->data;
 
     if (phys->body) {
@@ -24,12 +24,11 @@ static void cleanup(gameComponentT* component, gameSubsystemT* subsystem) {
 }
 
 gameComponentT* newPhysicsComponent(float mass) {
-    gameComponentT* component = newComponent("physics");
-    physicsComponentDataT* data = calloc(1, sizeof(physicsComponentDataT));
+    gameComponentT* component = newComponent("physics", sizeof(physicsComponentDataT));
+    physicsComponentDataT* data = component->data;
 
     data->body = bodyNewSquare(0.3f, 0.3f, mass);
 
-    component->data       = data;
     component->cleanup_fn = cleanup;
 
     return (component);
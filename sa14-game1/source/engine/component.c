@@ -5,24 +5,95 @@
 #include "component.h"
 
 #include "base/common.h"
+#include "base/debug.h"
+#include "base/pool.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// The number of components (or blocks of component data) allocated from the
+// heap at a time.
+#define ComponentsPerChunk 256
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct {
+    size_t size;
+    poolT* pool;
+} dataPoolT;
+
+/*------------------------------------------------
+ * GLOBALS
+ *----------------------------------------------*/
+
+static poolT* component_pool;
+
+// One pool for each size of component data. There are only a few component
+// types, so a short list is enough.
+static dataPoolT data_pools[MaxSubsystems];
+static int       num_data_pools;
 
 /*------------------------------------------------
  * FUNCTIONS
  *----------------------------------------------*/
 
-gameComponentT* newComponent(const string* subsystem_name) {
-    gameComponentT* component = calloc(1, sizeof(gameComponentT));
+static poolT* dataPool(size_t size) {
+    for (int i = 0; i < num_data_pools; i++) {
+        if (data_pools[i].size == size)
+            return (data_pools[i].pool);
+    }
+
+    if (num_data_pools >= MaxSubsystems)
+        error("too many component data sizes");
+
+    dataPoolT* data_pool = &data_pools[num_data_pools++];
+
+    data_pool->size = size;
+    data_pool->pool = poolNew(size, ComponentsPerChunk);
+
+    return (data_pool->pool);
+}
+
+void* allocComponentData(size_t size) {
+    void* data = poolAlloc(dataPool(size));
+
+    memset(data, 0, size);
+
+    return (data);
+}
+
+void releaseComponentData(void* data, size_t size) {
+    poolRelease(dataPool(size), data);
+}
+
+gameComponentT* newComponent(const string* subsystem_name, size_t data_size) {
+    if (!component_pool)
+        component_pool = poolNew(sizeof(gameComponentT), ComponentsPerChunk);
+
+    gameComponentT* component = poolAlloc(component_pool);
+
+    memset(component, 0, sizeof(gameComponentT));
 
     component->subsystem_name = subsystem_name;
+    component->subsystem_id   = subsystemNameId(subsystem_name);
+    component->data           = allocComponentData(data_size);
+    component->data_size      = data_size;
 
     return (component);
 }
 
 void freeComponent(gameComponentT* component) {
+    assert(component->subsystem == NULL);
+
     if (component->cleanup_fn)
         component->cleanup_fn(component);
 
-    free(component);
+    releaseComponentData(component->data, component->data_size);
+    poolRelease(component_pool, component);
 }
@@ -11,6 +11,8 @@ typedef struct gameComponentT gameComponentT;
 #include "engine/entity.h"
 #include "engine/subsystem.h"
 
+#include <stddef.h> // size_t
+
 /*------------------------------------------------
  * TYPES
  *----------------------------------------------*/
@@ -19,8 +21,10 @@ struct gameComponentT {
     gameEntityT* entity;
     gameSubsystemT* subsystem;
     string* subsystem_name;
+    int subsystem_id; // The interned subsystem name.
 
     void* data;
+    size_t data_size;
     void (*init_fn)(gameComponentT*);
     void (*update_fn)(gameComponentT*, float);
     void (*cleanup_fn)(gameComponentT*);
@@ -30,7 +34,18 @@ struct gameComponentT {
  * FUNCTIONS
  *----------------------------------------------*/
 
-gameComponentT* newComponent(const string* subsystem_name);
+// Creates a component with zeroed data of the specified size. Components and
+// their data come from pools, so creating and freeing them doesn't go through
+// the heap once the game has warmed up.
+gameComponentT* newComponent(const string* subsystem_name, size_t data_size);
+
+// Frees the component and its data. The component must not be in a subsystem.
 void freeComponent(gameComponentT* component);
 
+// Holds the data of components that are not in a subsystem, before they are
+// added to one or after they have been removed. Subsystems move component data
+// in and out of their component pools with these.
+void* allocComponentData(size_t size);
+void releaseComponentData(void* data, size_t size);
+
 #endif // component_h_
@@ -0,0 +1,224 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "componentpool.h"
+
+#include "base/common.h"
+#include "base/debug.h"
+#include "engine/component.h"
+#include "engine/entity.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// The number of components that a pool makes room for the first time a
+// component is added.
+#define InitialPoolCapacity 64
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+struct componentPoolT {
+    size_t data_size;
+    size_t stride; // The data size, padded to keep every block aligned.
+
+    int num_components;
+    int max_components;
+
+    // Dense arrays, indexed by the position of the component in the pool.
+    char*            data;
+    gameComponentT** components;
+
+    // Sparse array, indexed by entity id. Holds the position of the entity's
+    // component in the dense arrays, or -1 if it has none.
+    int* indices;
+    int  max_entities;
+};
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static void* slotData(const componentPoolT* pool, int i) {
+    return (pool->data + i*pool->stride);
+}
+
+static void growDense(componentPoolT* pool) {
+    int max_components = max(InitialPoolCapacity, 2*pool->max_components);
+
+    pool->data       = realloc(pool->data, max_components*pool->stride);
+    pool->components = realloc(pool->components,
+                               max_components*sizeof(gameComponentT*));
+
+    pool->max_components = max_components;
+
+    // The data array may have moved, so every component needs to be pointed
+    // at its new data.
+    for (int i = 0; i < pool->num_components; i++)
+        pool->components[i]->data = slotData(pool, i);
+}
+
+static void growSparse(componentPoolT* pool, int entity_id) {
+    int max_entities = max(InitialPoolCapacity, pool->max_entities);
+    while (max_entities <= entity_id)
+        max_entities *= 2;
+
+    pool->indices = realloc(pool->indices, max_entities*sizeof(int));
+
+    for (int i = pool->max_entities; i < max_entities; i++)
+        pool->indices[i] = -1;
+
+    pool->max_entities = max_entities;
+}
+
+componentPoolT* componentPoolNew(size_t data_size) {
+    componentPoolT* pool = calloc(1, sizeof(componentPoolT));
+
+    size_t align = sizeof(void*);
+
+    pool->data_size = data_size;
+    pool->stride    = max((data_size + align - 1) & ~(align - 1), align);
+
+    return (pool);
+}
+
+void componentPoolFree(componentPoolT* pool) {
+    free(pool->data);
+    free(pool->components);
+    free(pool->indices);
+    free(pool);
+}
+
+int componentPoolLength(const componentPoolT* pool) {
+    return (pool->num_components);
+}
+
+void componentPoolAdd(componentPoolT* pool, gameComponentT* component) {
+    int entity_id = component->entity->id;
+
+    assert(entity_id >= 0);
+
+    if (entity_id >= pool->max_entities)
+        growSparse(pool, entity_id);
+
+    assert(pool->indices[entity_id] < 0);
+
+    if (pool->num_components >= pool->max_components)
+        growDense(pool);
+
+    int   i    = pool->num_components++;
+    void* data = slotData(pool, i);
+
+    assert(component->data_size == pool->data_size);
+
+    memset(data, 0, pool->stride);
+
+    if (component->data) {
+        memcpy(data, component->data, pool->data_size);
+        releaseComponentData(component->data, component->data_size);
+    }
+
+    component->data = data;
+
+    pool->components[i]      = component;
+    pool->indices[entity_id] = i;
+}
+
+void componentPoolRemove(componentPoolT* pool, gameComponentT* component) {
+    int entity_id = component->entity->id;
+    int i         = pool->indices[entity_id];
+
+    assert(i >= 0 && pool->components[i] == component);
+
+    // The data goes with the component, so it can be added to a pool again.
+    void* data = allocComponentData(pool->data_size);
+    memcpy(data, slotData(pool, i), pool->data_size);
+
+    int last = --pool->num_components;
+
+    if (i != last) {
+        gameComponentT* moved = pool->components[last];
+
+        memcpy(slotData(pool, i), slotData(pool, last), pool->stride);
+
+        pool->components[i] = moved;
+
+        pool->indices[moved->entity->id] = i;
+        moved->data = slotData(pool, i);
+    }
+
+    pool->indices[entity_id] = -1;
+    component->data = data;
+}
+
+gameComponentT* componentPoolGet(const componentPoolT* pool, int entity_id) {
+    if (entity_id < 0 || entity_id >= pool->max_entities)
+        return (NULL);
+
+    int i = pool->indices[entity_id];
+    if (i < 0)
+        return (NULL);
+
+    return (pool->components[i]);
+}
+
+gameComponentT* componentPoolComponent(const componentPoolT* pool, int i) {
+    assert(i >= 0 && i < pool->num_components);
+    return (pool->components[i]);
+}
+
+void* componentPoolData(const componentPoolT* pool, int i) {
+    assert(i >= 0 && i < pool->num_components);
+    return (slotData(pool, i));
+}
+
+void componentPoolSwap(componentPoolT* pool, int i, int j) {
+    if (i == j)
+        return;
+
+    gameComponentT* a = pool->components[i];
+    gameComponentT* b = pool->components[j];
+
+    char* a_data = slotData(pool, i);
+    char* b_data = slotData(pool, j);
+
+    for (size_t k = 0; k < pool->stride; k++) {
+        char tmp  = a_data[k];
+        a_data[k] = b_data[k];
+        b_data[k] = tmp;
+    }
+
+    pool->components[i] = b;
+    pool->components[j] = a;
+
+    pool->indices[a->entity->id] = j;
+    pool->indices[b->entity->id] = i;
+
+    a->data = slotData(pool, j);
+    b->data = slotData(pool, i);
+}
+
+void componentPoolUpdate(componentPoolT* pool, float dt) {
+    componentPoolUpdateRange(pool, 0, pool->num_components, dt);
+}
+
+void componentPoolUpdateRange(componentPoolT* pool, int begin, int end,
+                              float dt)
+{
+    assert(begin >= 0 && end <= pool->num_components);
+
+    // The update function is read from the component every time, so that it
+    // can be changed while the component is in the pool.
+    for (int i = begin; i < end; i++) {
+        gameComponentT* component = pool->components[i];
+
+        if (component->update_fn)
+            component->update_fn(component, dt);
+    }
+}
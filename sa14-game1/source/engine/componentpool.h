@@ -0,0 +1,63 @@
+#ifndef componentpool_h_
+#define componentpool_h_
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+// Holds the data of all components in a subsystem, packed together in a
+// single array in the order the components were added, so that subsystems can
+// run through all their component data in one linear loop. Components can be
+// found by the id of their entity, and an entity can have at most one
+// component in each pool. Removing a component moves the last one into its
+// place, so component data moves around as components are added and removed.
+typedef struct componentPoolT componentPoolT;
+
+#include "base/common.h"
+#include "engine/component.h"
+
+#include <stddef.h> // size_t
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+// Creates a pool for component data of the specified size.
+componentPoolT* componentPoolNew(size_t data_size);
+void componentPoolFree(componentPoolT* pool);
+
+// Returns the number of components in the pool.
+int componentPoolLength(const componentPoolT* pool);
+
+// Adds a component to the pool. The data that the component points to is
+// copied into the pool and released (see allocComponentData()), and the
+// component is pointed at its data in the pool instead.
+void componentPoolAdd(componentPoolT* pool, gameComponentT* component);
+
+// Removes a component from the pool. The component data is copied out of the
+// pool into a block from allocComponentData().
+void componentPoolRemove(componentPoolT* pool, gameComponentT* component);
+
+// Returns the component of the entity with the specified id, or NULL if it
+// has none in this pool.
+gameComponentT* componentPoolGet(const componentPoolT* pool, int entity_id);
+
+// Returns the component and data at index i, from zero up to the length of
+// the pool. The data of all components are packed together, so the data of
+// component i+1 comes right after that of component i.
+gameComponentT* componentPoolComponent(const componentPoolT* pool, int i);
+void* componentPoolData(const componentPoolT* pool, int i);
+
+// Swaps the components at index i and j, for subsystems that want their
+// components in a certain order.
+void componentPoolSwap(componentPoolT* pool, int i, int j);
+
+// Calls the update function of every component in the pool.
+void componentPoolUpdate(componentPoolT* pool, float dt);
+
+// Calls the update functions of the components at index begin up to (but not
+// including) end.
+void componentPoolUpdateRange(componentPoolT* pool, int begin, int end,
+                              float dt);
+
+#endif // componentpool_h_
@@ -1,44 +1,123 @@
 #include "entity.h"
 
-#include "base/array.h"
 #include "base/common.h"
 #include "base/debug.h"
+#include "base/pool.h"
 #include "engine/component.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+// Handles hold the entity id in the low bits and the id generation in the
+// rest.
+#define EntityIdBits 20
+#define MaxEntities  (1 << EntityIdBits)
+#define MaxGeneration ((1 << (32 - EntityIdBits)) - 1)
+
+// The number of entities allocated from the heap at a time.
+#define EntitiesPerChunk 256
+
+static poolT* entity_pool;
+
+// Entities by id, the current generation of each id, and the ids of freed
+// entities, ready to be reused.
+static gameEntityT** entities;
+static uint32_t*     generations;
+static int*          free_ids;
+static int           num_free_ids;
+static int           num_ids;
+static int           max_ids;
+
+static int allocEntityId(void) {
+    if (num_free_ids > 0)
+        return (free_ids[--num_free_ids]);
+
+    if (num_ids >= MaxEntities)
+        error("too many entities");
+
+    if (num_ids >= max_ids) {
+        max_ids = max(EntitiesPerChunk, 2*max_ids);
+
+        entities    = realloc(entities   , max_ids * sizeof(gameEntityT*));
+        generations = realloc(generations, max_ids * sizeof(uint32_t));
+        free_ids    = realloc(free_ids   , max_ids * sizeof(int));
+    }
+
+    // Generation zero is never used, so that NullEntity is never valid.
+    generations[num_ids] = 1;
+
+    return (num_ids++);
+}
+
+static void releaseEntityId(int id) {
+    entities[id] = NULL;
+
+    // Wrapping the generation around would let old handles find new
+    // entities, so an id that has used up its generations is retired
+    // instead. Handles to it keep finding nothing.
+    if (generations[id] == MaxGeneration)
+        return;
+
+    generations[id]++;
+    free_ids[num_free_ids++] = id;
+}
+
 gameEntityT* newEntity(void) {
-    gameEntityT* entity = calloc(1, sizeof(gameEntityT));
-    
-    entity->components = arrayNew(sizeof(gameComponentT*));
+    if (!entity_pool)
+        entity_pool = poolNew(sizeof(gameEntityT), EntitiesPerChunk);
+
+    gameEntityT* entity = poolAlloc(entity_pool);
+
+    memset(entity, 0, sizeof(gameEntityT));
+
+    entity->id = allocEntityId();
+    entities[entity->id] = entity;
 
     return (entity);
 }
 
 void freeEntity(gameEntityT* entity) {
-    if (entity->components) {
-        arrayFree(entity->components);
-        entity->components = NULL;
+    if (entity->game)
+        removeEntityFromGame(entity);
+
+    for (int i = 0; i < MaxSubsystems; i++) {
+        if (entity->slots[i])
+            freeComponent(entity->slots[i]);
     }
 
-    free(entity);
+    if (entity->cleanup_fn)
+        entity->cleanup_fn(entity);
+    else
+        free(entity->data);
+
+    releaseEntityId(entity->id);
+    poolRelease(entity_pool, entity);
+}
+
+entityHandleT entityHandle(const gameEntityT* entity) {
+    return ((generations[entity->id] << EntityIdBits) | entity->id);
+}
+
+gameEntityT* entityFromHandle(entityHandleT handle) {
+    int      id         = handle & (MaxEntities - 1);
+    uint32_t generation = handle >> EntityIdBits;
+
+    if (id >= num_ids || generations[id] != generation)
+        return (NULL);
+
+    return (entities[id]);
 }
 
 void attachComponent(gameEntityT* entity, gameComponentT* component) {
     assert(component->entity == NULL);
 
+    // An entity can only have one component for each subsystem.
+    assert(entity->slots[component->subsystem_id] == NULL);
+
     component->entity = entity;
-    arrayAdd(entity->components, &component);
+    entity->slots[component->subsystem_id] = component;
 }
 
 gameComponentT* getComponent(gameEntityT* entity, const string* subsystem_name) {
-    int num_components = arrayLength(entity->components);
-    for (int i = 0; i < num_components; i++) {
-        gameComponentT* component = *(gameComponentT**)arrayGet(entity->components, i);
-        if (strcmp(component->subsystem_name, subsystem_name)==0)
-            return (component);
-    }
-
-    return (NULL);
+    return (getComponentById(entity, subsystemNameId(subsystem_name)));
 }
@@ -3,22 +3,59 @@
 
 typedef struct gameEntityT gameEntityT;
 
-#include "base/array.h"
 #include "base/common.h"
 #include "engine/component.h"
 #include "engine/game.h"
+#include "engine/subsystem.h"
+
+#include <stdint.h>
+
+// Refers to an entity without pointing to it. Entity ids are reused after
+// entities are freed, so handles also hold the generation of the id, which
+// changes every time the id is reused. A handle to a freed entity never finds
+// the entity that got its id afterwards. Ids that have been through all
+// generations are never reused, rather than starting over.
+typedef uint32_t entityHandleT;
+
+// A handle that never refers to an entity.
+#define NullEntity ((entityHandleT)0)
 
 struct gameEntityT {
+    int id; // Small and non-negative. Reused after the entity is freed.
     gameT* game;
-    arrayT* components;
     void* data;
+
+    // Frees the entity data. Called by freeEntity(). The data is freed with
+    // free() if this is NULL.
+    void (*cleanup_fn)(gameEntityT*);
+
+    // The components of the entity, by subsystem id.
+    gameComponentT* slots[MaxSubsystems];
 };
 
 
+// Entities come from a pool and their ids from a free list, so creating and
+// freeing entities doesn't go through the heap once the game has warmed up.
 gameEntityT* newEntity(void);
+
+// Frees the entity and all its components. The entity is removed from the
+// game first if it's in one.
 void freeEntity(gameEntityT* entity);
 
+entityHandleT entityHandle(const gameEntityT* entity);
+
+// Returns the entity that the handle refers to, or NULL if it has been freed.
+gameEntityT* entityFromHandle(entityHandleT handle);
+
 void attachComponent(gameEntityT* entity, gameComponentT* component);
+
+// Looks up the subsystem id from the name on every call. Use
+// getComponentById() with an id from subsystemNameId() in code that runs
+// every frame.
 gameComponentT* getComponent(gameEntityT* entity, const string* subsystem_name);
 
+static inline gameComponentT* getComponentById(const gameEntityT* entity, int subsystem_id) {
+    return (entity->slots[subsystem_id]);
+}
+
 #endif // gameentity_h_
@@ -7,8 +7,11 @@
 #include "base/common.h"
 #include "base/debug.h"
 #include "base/fileio.h"
+#include "base/jobs.h"
 #include "base/pak.h"
+#include "base/thread.h"
 #include "base/time.h"
+#include "engine/scheduler.h"
 #include "graphics/graphics.h"
 #include "graphics/text.h"
 #include "input/keyboard.h"
@@ -32,7 +35,31 @@ struct gameT {
     arrayT* entities;
     arrayT* subsystems;
 
-    bool done;
+    // Handles of the entities to free at the end of the frame. Entities can
+    // be destroyed from several threads at once, hence the lock.
+    arrayT* dead_entities;
+    mutexT* dead_lock;
+
+    jobSystemT* jobs;
+    schedulerT* scheduler;
+
+    gameSubsystemT* subsystem_ids[MaxSubsystems]; // Subsystems by id.
+
+    void (*frame_func)(float dt);
+
+    // Pipelined mode, see gameSetPipelined(). The update thread works on one
+    // frame while the main thread draws the one before it from the other
+    // snapshot buffer.
+    bool     pipelined;
+    threadT* update_thread;
+    mutexT*  update_lock;
+    condT*   update_cond;
+    bool     updating;      // Set while the update thread is busy.
+    bool     quit_update;
+    float    update_dt;
+    int      render_buffer; // The snapshot buffer to draw from.
+
+    bool done; // Guarded by update_lock while there is an update thread.
 };
 
 /*------------------------------------------------
@@ -54,6 +81,11 @@ static void gameCleanup(void) {
     }
 
     arrayFree(game_inst->subsystems);
+    arrayFree(game_inst->dead_entities);
+    mutexFree(game_inst->dead_lock);
+
+    schedulerFree(game_inst->scheduler);
+    jobSystemFree(game_inst->jobs);
 
     free(game_inst);
     game_inst = NULL;
@@ -66,53 +98,189 @@ static void queryInputDevices(void) {
     updateMouseState();
 }
 
-static void updateComponents(gameSubsystemT* subsystem, float dt) {
-    int num_components = arrayLength(subsystem->components);
-    for (int i = 0; i < num_components; i++) {
-        gameComponentT* component = *(gameComponentT**)arrayGet(subsystem->components, i);
+static void freeDeadEntities(void) {
+    arrayT* dead_entities = game_inst->dead_entities;
 
-        if (component->update_fn)
-            component->update_fn(component, dt);
+    for (int i = 0; i < arrayLength(dead_entities); i++) {
+        entityHandleT handle = *(entityHandleT*)arrayGet(dead_entities, i);
+        gameEntityT*  entity = entityFromHandle(handle);
+
+        if (entity)
+            freeEntity(entity);
     }
+
+    arrayClear(dead_entities);
 }
 
 static void updateSubsystems(float dt) {
+    // Subsystems that have declared what they access are updated side by side
+    // where they don't get in each other's way. The rest are updated one by
+    // one on this thread, in the order they were added.
+    schedulerUpdate(game_inst->scheduler, game_inst->subsystems, dt);
+}
+
+static void snapshotSubsystems(int buffer) {
     int num_subsystems = arrayLength(game_inst->subsystems);
     for (int i = 0; i < num_subsystems; i++) {
         gameSubsystemT* subsystem = *(gameSubsystemT**)arrayGet(game_inst->subsystems, i);
 
-        if (subsystem->before_update_fn)
-            subsystem->before_update_fn(subsystem, dt);
+        if (subsystem->snapshot_fn)
+            subsystem->snapshot_fn(subsystem, buffer);
+    }
+}
 
-        updateComponents(subsystem, dt);
+static void renderSubsystems(int buffer, float dt) {
+    int num_subsystems = arrayLength(game_inst->subsystems);
+    for (int i = 0; i < num_subsystems; i++) {
+        gameSubsystemT* subsystem = *(gameSubsystemT**)arrayGet(game_inst->subsystems, i);
 
-        if (subsystem->after_update_fn)
-            subsystem->after_update_fn(subsystem, dt);
+        if (subsystem->render_fn)
+            subsystem->render_fn(subsystem, buffer, dt);
     }
 }
 
+static void updateFrame(float dt) {
+    if (game_inst->frame_func)
+        game_inst->frame_func(dt);
+
+    updateSubsystems(dt);
+}
+
+static void endFrame(int buffer) {
+    // Freeing entities may free meshes, and the snapshot refers to them, so
+    // this happens on the main thread while nothing else touches the game.
+    freeDeadEntities();
+    snapshotSubsystems(buffer);
+}
+
+static void updateThreadMain(void* arg) {
+    mutexLock(game_inst->update_lock);
+
+    while (true) {
+        while (!game_inst->updating && !game_inst->quit_update)
+            condWait(game_inst->update_cond, game_inst->update_lock);
+
+        if (game_inst->quit_update)
+            break;
+
+        float dt = game_inst->update_dt;
+
+        mutexUnlock(game_inst->update_lock);
+        updateFrame(dt);
+        mutexLock(game_inst->update_lock);
+
+        game_inst->updating = false;
+        condBroadcast(game_inst->update_cond);
+    }
+
+    mutexUnlock(game_inst->update_lock);
+}
+
+static void startUpdateThread(void) {
+    for (int i = 0; i < arrayLength(game_inst->subsystems); i++) {
+        gameSubsystemT* subsystem = *(gameSubsystemT**)arrayGet(game_inst->subsystems, i);
+
+        if (subsystem->main_thread)
+            error("subsystem %s needs the main thread", subsystem->name);
+    }
+
+    // Gives the first frame something to draw.
+    game_inst->render_buffer = 0;
+    snapshotSubsystems(0);
+
+    game_inst->update_lock   = mutexNew();
+    game_inst->update_cond   = condNew();
+    game_inst->updating      = false;
+    game_inst->quit_update   = false;
+    game_inst->update_thread = threadNew(updateThreadMain, NULL);
+}
+
+static void stopUpdateThread(void) {
+    mutexLock(game_inst->update_lock);
+    game_inst->quit_update = true;
+    condBroadcast(game_inst->update_cond);
+    mutexUnlock(game_inst->update_lock);
+
+    threadJoin(game_inst->update_thread);
+    condFree(game_inst->update_cond);
+    mutexFree(game_inst->update_lock);
+
+    game_inst->update_thread = NULL;
+}
+
+static void startUpdate(float dt) {
+    mutexLock(game_inst->update_lock);
+    game_inst->update_dt = dt;
+    game_inst->updating  = true;
+    condBroadcast(game_inst->update_cond);
+    mutexUnlock(game_inst->update_lock);
+}
+
+// Waits for the update thread and returns whether the game is done.
+static bool finishUpdate(void) {
+    mutexLock(game_inst->update_lock);
+
+    while (game_inst->updating)
+        condWait(game_inst->update_cond, game_inst->update_lock);
+
+    bool done = game_inst->done;
+
+    mutexUnlock(game_inst->update_lock);
+
+    // The update thread is idle and we're done drawing, so the snapshot of
+    // the frame that was just updated can be taken. It's drawn next.
+    endFrame(1 - game_inst->render_buffer);
+    game_inst->render_buffer = 1 - game_inst->render_buffer;
+
+    return (done);
+}
+
 void initGame(const string* title, int screen_width, int screen_height) {
     assert(game_inst == NULL);
 
     initGraphics(title, screen_width, screen_height);
 
-    game_inst = malloc(sizeof(gameT));
+    game_inst = calloc(1, sizeof(gameT));
 
-    game_inst->resources  = NULL;
-    game_inst->entities   = arrayNew(sizeof(gameEntityT*));
-    game_inst->subsystems = arrayNew(sizeof(gameSubsystemT*));
+    game_inst->resources     = NULL;
+    game_inst->entities      = arrayNew(sizeof(gameEntityT*));
+    game_inst->subsystems    = arrayNew(sizeof(gameSubsystemT*));
+    game_inst->dead_entities = arrayNew(sizeof(entityHandleT));
+    game_inst->dead_lock     = mutexNew();
+    game_inst->jobs          = jobSystemNew(0);
+    game_inst->scheduler     = schedulerNew(game_inst->jobs);
 }
 
 void exitGame(void) {
-    if (game_inst)
+    if (!game_inst)
+        return;
+
+    // The frame function may call us from the update thread.
+    if (game_inst->update_thread) {
+        mutexLock(game_inst->update_lock);
         game_inst->done = true;
+        mutexUnlock(game_inst->update_lock);
+    }
+    else {
+        game_inst->done = true;
+    }
+}
+
+void gameSetPipelined(bool pipelined) {
+    assert(game_inst->update_thread == NULL);
+    game_inst->pipelined = pipelined;
 }
 
 void gameMain(void (*frame_func)(float dt)) {
-    game_inst->done = false;
+    game_inst->done       = false;
+    game_inst->frame_func = frame_func;
 
+    if (game_inst->pipelined)
+        startUpdateThread();
+
+    bool  done = false;
     timeT time = getTime();
-    while (!game_inst->done && windowIsOpen()) {
+    while (!done && windowIsOpen()) {
         float dt = elapsedSecsSince(time);
 
         // Pause if we lose focus. The time we pause should not be taken into
@@ -131,31 +299,47 @@ void gameMain(void (*frame_func)(float dt)) {
 
         time = getTime();
 
-        if (frame_func)
-            frame_func(dt);
-
         queryInputDevices();
-        updateSubsystems(dt);
+
+        if (game_inst->pipelined) {
+            // Drawing happens while the update thread works on this frame, so
+            // what we draw is always one frame behind.
+            int buffer = game_inst->render_buffer;
+
+            startUpdate(dt);
+            renderSubsystems(buffer, dt);
+            done = finishUpdate();
+        }
+        else {
+            updateFrame(dt);
+            endFrame(0);
+            renderSubsystems(0, dt);
+
+            done = game_inst->done;
+        }
+
         updateDisplay();
     }
 
+    if (game_inst->pipelined)
+        stopUpdateThread();
+
     gameCleanup();
 }
 
 void addSubsystemToGame(gameSubsystemT* subsystem) {
+    assert(game_inst->subsystem_ids[subsystem->id] == NULL);
+
     arrayAdd(game_inst->subsystems, &subsystem);
+    game_inst->subsystem_ids[subsystem->id] = subsystem;
 }
 
-gameSubsystemT* getGameSubsystem(const string* name) {
-    int num_subsystems = arrayLength(game_inst->subsystems);
-    for (int i = 0; i < num_subsystems; i++) {
-        gameSubsystemT* subsystem = *(gameSubsystemT**)arrayGet(game_inst->subsystems, i);
-
-        if (strcmp(subsystem->name, name)==0)
-            return (subsystem);
-    }
+jobSystemT* gameJobSystem(void) {
+    return (game_inst->jobs);
+}
 
-    return (NULL);
+gameSubsystemT* getGameSubsystem(const string* name) {
+    return (game_inst->subsystem_ids[subsystemNameId(name)]);
 }
 
 void addEntityToGame(gameEntityT* entity) {
@@ -163,11 +347,12 @@ void addEntityToGame(gameEntityT* entity) {
 
     entity->game = game_inst;
 
-    int num_components = arrayLength(entity->components);
-    for (int i = 0; i < num_components; i++) {
-        gameComponentT* component = *(gameComponentT**)arrayGet(entity->components, i);
+    for (int i = 0; i < MaxSubsystems; i++) {
+        gameComponentT* component = entity->slots[i];
+        if (!component)
+            continue;
 
-        gameSubsystemT* subsystem = getGameSubsystem(component->subsystem_name);
+        gameSubsystemT* subsystem = game_inst->subsystem_ids[component->subsystem_id];
         assert(subsystem != NULL);
 
         addComponentToSubsystem(component, subsystem);
@@ -178,9 +363,24 @@ void removeEntityFromGame(gameEntityT* entity) {
     if (!entity->game)
         return;
 
+    for (int i = 0; i < MaxSubsystems; i++) {
+        gameComponentT* component = entity->slots[i];
+
+        if (component && component->subsystem)
+            removeComponentFromSubsystem(component);
+    }
+
     entity->game = NULL;
 }
 
+void destroyEntity(gameEntityT* entity) {
+    entityHandleT handle = entityHandle(entity);
+
+    mutexLock(game_inst->dead_lock);
+    arrayAdd(game_inst->dead_entities, &handle);
+    mutexUnlock(game_inst->dead_lock);
+}
+
 void gameAddResource(const string* name, void* data, int type) {
     if (gameResource(name, -1))
         error("attempted to add duplicate resource");
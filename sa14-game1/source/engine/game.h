@@ -8,6 +8,7 @@
 typedef struct gameT gameT;
 
 #include "base/common.h"
+#include "base/jobs.h"
 #include "base/pak.h"
 #include "engine/component.h"
 #include "engine/entity.h"
@@ -24,9 +25,35 @@ void exitGame(void);
 
 void gameMain(void(*frame_func)(float dt));
 
+// In pipelined mode, the game is updated on a thread of its own while the main
+// thread draws the previous frame, so a frame takes about as long as the
+// slower of the two instead of both added up. What's on screen lags one frame
+// further behind. The frame function and all update functions run on the
+// update thread, so they must not use OpenGL (load meshes up front instead).
+// Destroyed entities are freed and snapshots are taken on the main thread, in
+// between the two. Off by default. Has to be set before gameMain() is called.
+void gameSetPipelined(bool pipelined);
+
 void addSubsystemToGame(gameSubsystemT* subsystem);
+
+// Returns the job system that the game updates its subsystems with. Subsystems
+// that want to spread their own work out over threads should use it instead of
+// starting another one, and set runs_jobs.
+jobSystemT* gameJobSystem(void);
+
+// Subsystems may be updated on several threads at once, so entities must not
+// be added or removed from update functions. Use destroyEntity() there.
 void addEntityToGame(gameEntityT* entity);
 
+// Takes the components of the entity out of their subsystems. The entity can
+// be added to the game again afterwards.
+void removeEntityFromGame(gameEntityT* entity);
+
+// Removes the entity from the game and frees it once the current frame is
+// done, so it's safe to call from update functions, on any thread. Destroying
+// an entity more than once is fine.
+void destroyEntity(gameEntityT* entity);
+
 void gameAddResource(const string* name, void* data, int type);
 const void* gameResource(const string* name, int type);
 
@@ -0,0 +1,244 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "scheduler.h"
+
+#include "base/array.h"
+#include "base/common.h"
+#include "base/debug.h"
+#include "base/jobs.h"
+#include "engine/componentpool.h"
+#include "engine/subsystem.h"
+
+#include <stdlib.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// The kinds of tasks that a subsystem update is split into.
+#define BeforeTask    0
+#define ComponentTask 1
+#define AfterTask     2
+
+#define MaxTasks (3*MaxSubsystems)
+
+// The number of components updated per job when a subsystem allows its
+// components to be updated in parallel.
+#define ComponentBatchSize 64
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct {
+    gameSubsystemT* subsystem;
+    int             kind;
+    int             wave;
+} taskT;
+
+// A task, or a range of components in a component task.
+typedef struct {
+    int task;
+    int begin;
+    int end;
+} workItemT;
+
+struct schedulerT {
+    jobSystemT* jobs;
+
+    taskT tasks[MaxTasks];
+    int   num_tasks;
+    int   num_waves;
+
+    arrayT* items; // The work items of the current wave.
+    float   dt;
+};
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static const subsystemAccessT* taskAccess(const taskT* task) {
+    int stage = (task->kind == ComponentTask) ? ComponentStage : UpdateStage;
+    return (&task->subsystem->access[stage]);
+}
+
+static bool taskOnMainThread(const taskT* task) {
+    // We don't know what undeclared tasks do, so they run where they always
+    // did.
+    if (!taskAccess(task)->declared)
+        return (true);
+
+    // The same goes for tasks that start jobs, since they can't do that from
+    // inside one.
+    const gameSubsystemT* subsystem = task->subsystem;
+
+    return (task->kind != ComponentTask
+         && (subsystem->main_thread || subsystem->runs_jobs));
+}
+
+static bool tasksConflict(const taskT* a, const taskT* b) {
+    // The stages of a subsystem always run in order.
+    if (a->subsystem == b->subsystem)
+        return (true);
+
+    const subsystemAccessT* a_access = taskAccess(a);
+    const subsystemAccessT* b_access = taskAccess(b);
+
+    if (!a_access->declared || !b_access->declared)
+        return (true);
+
+    return ((a_access->writes & (b_access->reads | b_access->writes))
+         || (b_access->writes & a_access->reads));
+}
+
+static void addTask(schedulerT* scheduler, gameSubsystemT* subsystem,
+                    int kind)
+{
+    assert(scheduler->num_tasks < MaxTasks);
+
+    taskT* task = &scheduler->tasks[scheduler->num_tasks++];
+
+    task->subsystem = subsystem;
+    task->kind      = kind;
+    task->wave      = 0;
+
+    // Each task goes in the wave after the last one holding a task that it
+    // conflicts with.
+    for (int i = 0; i < scheduler->num_tasks-1; i++) {
+        const taskT* earlier = &scheduler->tasks[i];
+
+        if (tasksConflict(earlier, task))
+            task->wave = max(task->wave, earlier->wave+1);
+    }
+
+    scheduler->num_waves = max(scheduler->num_waves, task->wave+1);
+}
+
+static void buildTasks(schedulerT* scheduler, const arrayT* subsystems) {
+    scheduler->num_tasks = 0;
+    scheduler->num_waves = 0;
+
+    for (int i = 0; i < arrayLength(subsystems); i++) {
+        gameSubsystemT* subsystem = *(gameSubsystemT**)arrayGet(subsystems, i);
+
+        if (subsystem->before_update_fn)
+            addTask(scheduler, subsystem, BeforeTask);
+
+        // The before_update_fn may add components, so the component task is
+        // there even if the pool is empty for now.
+        addTask(scheduler, subsystem, ComponentTask);
+
+        if (subsystem->after_update_fn)
+            addTask(scheduler, subsystem, AfterTask);
+    }
+}
+
+static void runWorkItem(schedulerT* scheduler, const workItemT* item) {
+    const taskT*    task      = &scheduler->tasks[item->task];
+    gameSubsystemT* subsystem = task->subsystem;
+
+    switch (task->kind) {
+
+    case BeforeTask:
+        subsystem->before_update_fn(subsystem, scheduler->dt);
+        break;
+
+    case ComponentTask:
+        componentPoolUpdateRange(subsystem->components, item->begin,
+                                 item->end, scheduler->dt);
+        break;
+
+    case AfterTask:
+        subsystem->after_update_fn(subsystem, scheduler->dt);
+        break;
+
+    }
+}
+
+static void runWorkItems(void* data, int begin, int end) {
+    schedulerT* scheduler = data;
+
+    for (int i = begin; i < end; i++)
+        runWorkItem(scheduler, arrayGet(scheduler->items, i));
+}
+
+static void addWorkItems(schedulerT* scheduler, int task_index) {
+    const taskT* task = &scheduler->tasks[task_index];
+    int          n    = 0;
+
+    if (task->kind == ComponentTask)
+        n = componentPoolLength(task->subsystem->components);
+
+    if (task->kind != ComponentTask || !task->subsystem->parallel_components) {
+        workItemT item = { task_index, 0, n };
+        arrayAdd(scheduler->items, &item);
+        return;
+    }
+
+    for (int begin = 0; begin < n; begin += ComponentBatchSize) {
+        workItemT item = { task_index, begin,
+                           min(begin+ComponentBatchSize, n) };
+
+        arrayAdd(scheduler->items, &item);
+    }
+}
+
+static void runWave(schedulerT* scheduler, int wave) {
+    arrayClear(scheduler->items);
+
+    for (int i = 0; i < scheduler->num_tasks; i++) {
+        const taskT* task = &scheduler->tasks[i];
+
+        if (task->wave == wave && !taskOnMainThread(task))
+            addWorkItems(scheduler, i);
+    }
+
+    int num_items = arrayLength(scheduler->items);
+
+    if (scheduler->jobs && num_items > 1)
+        jobsParallelFor(scheduler->jobs, runWorkItems, scheduler, num_items, 1);
+    else
+        runWorkItems(scheduler, 0, num_items);
+
+    // The main thread tasks go last, in the order they were added.
+    for (int i = 0; i < scheduler->num_tasks; i++) {
+        const taskT* task = &scheduler->tasks[i];
+
+        if (task->wave != wave || !taskOnMainThread(task))
+            continue;
+
+        int       n    = (task->kind == ComponentTask)
+                       ? componentPoolLength(task->subsystem->components) : 0;
+        workItemT item = { i, 0, n };
+
+        runWorkItem(scheduler, &item);
+    }
+}
+
+schedulerT* schedulerNew(jobSystemT* jobs) {
+    schedulerT* scheduler = calloc(1, sizeof(schedulerT));
+
+    scheduler->jobs  = jobs;
+    scheduler->items = arrayNew(sizeof(workItemT));
+
+    return (scheduler);
+}
+
+void schedulerFree(schedulerT* scheduler) {
+    arrayFree(scheduler->items);
+    free(scheduler);
+}
+
+void schedulerUpdate(schedulerT* scheduler, const arrayT* subsystems,
+                     float dt)
+{
+    scheduler->dt = dt;
+
+    buildTasks(scheduler, subsystems);
+
+    for (int i = 0; i < scheduler->num_waves; i++)
+        runWave(scheduler, i);
+}
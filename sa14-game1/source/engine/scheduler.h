@@ -0,0 +1,43 @@
+#ifndef scheduler_h_
+#define scheduler_h_
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/array.h"
+#include "base/common.h"
+#include "base/jobs.h"
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+// Runs the subsystem updates. Each subsystem update is split up into tasks
+// (before_update_fn, the component update functions and after_update_fn),
+// and the tasks are sorted into waves so that no two tasks in the same wave
+// access the same component type in conflicting ways (see subsystemReads()).
+// The waves run one after another, and the tasks within a wave run
+// concurrently. A task always runs after every earlier task that it
+// conflicts with, so the results are the same as when the subsystems are
+// updated one by one in the order they were added.
+typedef struct schedulerT schedulerT;
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+// Creates a scheduler that runs tasks on the threads of the job system. Pass
+// NULL to run everything on the calling thread. The tasks themselves must not
+// use the same job system, since jobs can't start other jobs.
+schedulerT* schedulerNew(jobSystemT* jobs);
+void schedulerFree(schedulerT* scheduler);
+
+// Updates the subsystems in the array (of gameSubsystemT pointers). The waves
+// are worked out again on every call, since the subsystems and the number of
+// components in them may change from frame to frame. Tasks of subsystems that
+// need the main thread or run jobs of their own are run on the calling thread.
+void schedulerUpdate(schedulerT* scheduler, const arrayT* subsystems,
+                     float dt);
+
+#endif // scheduler_h_
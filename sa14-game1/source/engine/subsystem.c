@@ -1,22 +1,42 @@
 #include "subsystem.h"
 
 #include "base/common.h"
+#include "base/debug.h"
 #include "engine/component.h"
 
 #include <stdlib.h>
+#include <string.h>
 
-gameSubsystemT* newSubsystem(const string* name) {
+static const string* subsystem_names[MaxSubsystems];
+static int num_subsystem_names = 0;
+
+int subsystemNameId(const string* name) {
+    for (int i = 0; i < num_subsystem_names; i++) {
+        if (strcmp(subsystem_names[i], name)==0)
+            return (i);
+    }
+
+    if (num_subsystem_names >= MaxSubsystems)
+        error("too many subsystem names");
+
+    subsystem_names[num_subsystem_names] = strdup(name);
+
+    return (num_subsystem_names++);
+}
+
+gameSubsystemT* newSubsystem(const string* name, size_t component_size) {
     gameSubsystemT* subsystem = calloc(1, sizeof(gameSubsystemT));
 
     subsystem->name       = name;
-    subsystem->components = arrayNew(sizeof(gameComponentT*));
+    subsystem->id         = subsystemNameId(name);
+    subsystem->components = componentPoolNew(component_size);
 
     return (subsystem);
 }
 
 void freeSubsystem(gameSubsystemT* subsystem) {
     if (subsystem->components) {
-        arrayFree(subsystem->components);
+        componentPoolFree(subsystem->components);
         subsystem->components = NULL;
     }
 
@@ -29,7 +49,7 @@ void freeSubsystem(gameSubsystemT* subsystem) {
 void addComponentToSubsystem(gameComponentT* component, gameSubsystemT* subsystem) {
     assert(component->subsystem == NULL);
     component->subsystem = subsystem;
-    arrayAdd(subsystem->components, &component);
+    componentPoolAdd(subsystem->components, component);
 
     if (component->init_fn)
         component->init_fn(component);
@@ -37,3 +57,32 @@ void addComponentToSubsystem(gameComponentT* component, gameSubsystemT* subsyste
     if (subsystem->add_component_fn)
         subsystem->add_component_fn(subsystem, component);
 }
+
+void subsystemReads(gameSubsystemT* subsystem, int stage, const string* name) {
+    assert(stage >= 0 && stage < NumStages);
+
+    subsystemAccessT* access = &subsystem->access[stage];
+
+    access->reads   |= 1u << subsystemNameId(name);
+    access->declared = true;
+}
+
+void subsystemWrites(gameSubsystemT* subsystem, int stage, const string* name) {
+    assert(stage >= 0 && stage < NumStages);
+
+    subsystemAccessT* access = &subsystem->access[stage];
+
+    access->writes  |= 1u << subsystemNameId(name);
+    access->declared = true;
+}
+
+void removeComponentFromSubsystem(gameComponentT* component) {
+    gameSubsystemT* subsystem = component->subsystem;
+    assert(subsystem != NULL);
+
+    if (subsystem->remove_component_fn)
+        subsystem->remove_component_fn(subsystem, component);
+
+    componentPoolRemove(subsystem->components, component);
+    component->subsystem = NULL;
+}
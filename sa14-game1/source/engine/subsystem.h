@@ -4,26 +4,93 @@
 #include "base/array.h"
 #include "base/common.h"
 
+#include <stddef.h> // size_t
+
+// The max number of different subsystem names. Entities have one component
+// slot for each, so this has to be defined before the entity type.
+#define MaxSubsystems 16
+
+// The stages of a subsystem update, for declaring what each stage accesses.
+#define UpdateStage    0 // before_update_fn and after_update_fn.
+#define ComponentStage 1 // The component update functions.
+#define NumStages      2
+
 typedef struct gameSubsystemT gameSubsystemT;
 
 #include "engine/component.h"
+#include "engine/componentpool.h"
+
+#include <stdint.h>
+
+// The component types that a stage reads and writes, as bit masks with one
+// bit for each subsystem id. A stage that hasn't declared anything is assumed
+// to access everything, so it never runs alongside anything else.
+typedef struct {
+    uint32_t reads;
+    uint32_t writes;
+    bool     declared;
+} subsystemAccessT;
 
 struct gameSubsystemT {
     const string* name;
-    arrayT* components;
+    int id; // The interned name, see subsystemNameId().
+    componentPoolT* components; // Holds the data of all components.
+
+    // Used by the game to decide which stages can run at the same time. See
+    // subsystemReads() and subsystemWrites().
+    subsystemAccessT access[NumStages];
+
+    // The update functions use something that only works on the main thread.
+    // Not allowed with gameSetPipelined(), which updates the game on a thread
+    // of its own. Drawing belongs in render_fn instead.
+    bool main_thread;
+
+    // The component update functions only touch their own component and
+    // entity, so different components can be updated on different threads.
+    bool parallel_components;
+
+    // The before and after update functions run jobs of their own on the
+    // game's job system (see gameJobSystem()). Jobs can't start other jobs, so
+    // these are run on the thread that updates the game, with no other jobs
+    // going on.
+    bool runs_jobs;
 
     void (*before_update_fn)(gameSubsystemT*, float);
     void (*after_update_fn)(gameSubsystemT*, float);
     void (*add_component_fn)(gameSubsystemT*, gameComponentT*);
+    void (*remove_component_fn)(gameSubsystemT*, gameComponentT*);
     void (*cleanup_fn)(gameSubsystemT*);
 
+    // Drawing is split off from the update, so that it can overlap with the
+    // next update (see gameSetPipelined()). snapshot_fn is called after the
+    // update and copies whatever render_fn needs into snapshot buffer 0 or 1.
+    // render_fn is always called on the main thread, and draws from a buffer
+    // filled in earlier. While it runs, the next frame may be updated on
+    // another thread, so it must not touch anything but the buffer.
+    void (*snapshot_fn)(gameSubsystemT*, int buffer);
+    void (*render_fn)(gameSubsystemT*, int buffer, float dt);
+
     void* data;
 };
 
 
-gameSubsystemT* newSubsystem(const string* name);
+// Creates a subsystem whose components all have data of the specified size.
+gameSubsystemT* newSubsystem(const string* name, size_t component_size);
 void freeSubsystem(gameSubsystemT* subsystem);
 
 void addComponentToSubsystem(gameComponentT* component, gameSubsystemT* subsystem);
+void removeComponentFromSubsystem(gameComponentT* component);
+
+// Declares that a stage of the subsystem reads or writes the components of the
+// named subsystem (or its subsystem data). Stages that don't conflict are run
+// concurrently on different threads, so a stage that accesses something it
+// hasn't declared is a data race.
+void subsystemReads(gameSubsystemT* subsystem, int stage, const string* name);
+void subsystemWrites(gameSubsystemT* subsystem, int stage, const string* name);
+
+// Interns a subsystem name to a small integer id, from zero up to
+// MaxSubsystems. The same name always gives the same id, so components and
+// subsystems can be matched up by id instead of by name.
+int subsystemNameId(const string* name);
 
 #endif // subsystem_h_
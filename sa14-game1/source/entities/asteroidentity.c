@@ -1,6 +1,7 @@
 #include "asteroidentity.h"
 
 #include "base/common.h"
+#include "base/pool.h"
 #include "components/graphicscomponent.h"
 #include "components/physicscomponent.h"
 #include "engine/entity.h"
@@ -10,6 +11,17 @@
 
 #include <stdlib.h>
 
+// The number of asteroids allocated from the heap at a time.
+#define AsteroidsPerChunk 64
+
+// Asteroids are spawned and destroyed all the time, so their data comes from
+// a pool.
+static poolT* asteroid_pool;
+
+// All asteroids share the same mesh.
+static triMeshT*  asteroid_mesh;
+static materialT* asteroid_mat;
+
 static vec3 randomVector(void) {
     vec3 v;
 
@@ -22,36 +34,38 @@ static vec3 randomVector(void) {
     return (v);
 }
 
-static gameComponentT* createGraphicsComponent(void) {
-    static triMeshT* mesh = NULL;
-    static materialT* mat = NULL;
-
-    if (!mesh) {
+void loadAsteroidResources(void) {
+    if (!asteroid_mesh) {
         //mesh = createGeodesicSphere(0.3f, 0);
         //mesh = createBox(0.3f, 0.3f, 0.3f);
         
         //a3dsDataT* a3ds = a3dsLoad(readGamePakFile("meshes/player.3ds"));
         //getchar();
 
-        const a3dsDataT* a3ds = gameResource      ("mesh:doughnut", ResMesh);
-                         mesh = a3dsCreateMesh    (a3ds, "doughnut");
-                         mat  = a3dsCreateMaterial(a3ds, "doughnut_materia");
+        const a3dsDataT* a3ds = gameResource("mesh:doughnut", ResMesh);
+
+        asteroid_mesh = a3dsCreateMesh    (a3ds, "doughnut");
+        asteroid_mat  = a3dsCreateMaterial(a3ds, "doughnut_materia");
 
         //a3dsFree(a3ds);
         //mesh = load3DS();
         //calcSmoothNormals(mesh);
         //updateMesh(mesh);
     }
+}
 
-    if (!mat) {
+static gameComponentT* createGraphicsComponent(void) {
+    loadAsteroidResources();
+
+    if (!asteroid_mat) {
 
-        mat = getNamedMaterial("shiny black");
+        asteroid_mat = getNamedMaterial("shiny black");
         if ((rand() % 4) == 0) {
-            mat = getNamedMaterial("blue crystal");
+            asteroid_mat = getNamedMaterial("blue crystal");
         }
     }
 
-    gameComponentT* component = newGraphicsComponent(mesh, mat);
+    gameComponentT* component = newGraphicsComponent(asteroid_mesh, asteroid_mat);
 
     return (component);
 }
@@ -116,17 +130,13 @@ static gameComponentT* createPhysicsComponent(void) {
 
 static void rotateAsteroid(gameComponentT* component, float dt) {
     asteroidEntityDataT*    asteroid = component->entity->data;
-    graphicsComponentDataT* gfx      = getComponent(component->entity, "graphics")->data;
-    physicsComponentDataT*  phys     = getComponent(component->entity, "physics" )->data;
-    
-    float o = bodyOrientation(phys->body);
-    //vec2  x = bodyPosition   (phys->body);
+    graphicsComponentDataT* gfx      = component->data;
     
-    mat4x4 m, r;
+    // The body orientation is applied by the graphics subsystem, which
+    // blends it between physics steps.
+    mat4x4 m;
 
     mat_identity (&m);
-    mat_rot_z    (o, &r);
-    mat_mul      (&r, &m, &m);
 
     asteroid->angle1 += dt * asteroid->a1;
     mat4x4 lol;
@@ -136,10 +146,18 @@ static void rotateAsteroid(gameComponentT* component, float dt) {
     gfx->transform = m;
 }
 
+static void freeAsteroid(gameEntityT* entity) {
+    poolRelease(asteroid_pool, entity->data);
+}
+
 gameEntityT* newAsteroidEntity(void) {
+    if (!asteroid_pool)
+        asteroid_pool = poolNew(sizeof(asteroidEntityDataT), AsteroidsPerChunk);
+
     gameEntityT* entity = newEntity();
 
-    entity->data = calloc(1, sizeof(asteroidEntityDataT));
+    entity->data       = poolAlloc(asteroid_pool);
+    entity->cleanup_fn = freeAsteroid;
 
     gameComponentT* gfx  = createGraphicsComponent();
     gfx->update_fn = rotateAsteroid;
@@ -1,6 +1,7 @@
 #ifndef asteroidentity_h_
 #define asteroidentity_h_
 
+#include "engine/entity.h"
 #include "math/vector.h"
 
 typedef struct {
@@ -13,4 +14,11 @@ typedef struct {
     vec3 rot_axis_2;
 } asteroidEntityDataT;
 
+// Loads the mesh that all asteroids share. Done by newAsteroidEntity() the
+// first time if needed, but it uses OpenGL, so call it on the main thread up
+// front when asteroids are created on another thread.
+void loadAsteroidResources(void);
+
+gameEntityT* newAsteroidEntity(void);
+
 #endif // asteroidentity_h_
@@ -8,49 +8,22 @@
 
 #include "math/matrix.h"
 
-static void playerDerivativeFn(const float* state, float* derivs) {
-    // state[0] = x.x
-    // state[1] = x.y
-    // state[2] = o
-    // state[3] = v.x
-    // state[4] = v.y
-    // state[5] = w
-
-    // derivs[0] = v.x
-    // derivs[1] = v.y
-    // derivs[2] = w
-    // derivs[3] = a.x
-    // derivs[4] = a.y
-    // derivs[5] = t
-
-    derivs[0] = state[3];
-    derivs[1] = state[4];
-    derivs[2] = state[5];
-    
-    derivs[3] = -state[3] * 5.0f;
-    derivs[4] = -state[4] * 5.0f;
-    derivs[5] = -state[5] * 5.0f;
-
-    if (keyIsPressed(ArrowLeft )) derivs[5] += 10.0f;
-    if (keyIsPressed(ArrowRight)) derivs[5] -= 10.0f;
-
-    if (keyIsPressed(ArrowUp)) {
-        vec2 f;
-
-        derivs[3] += cosf(state[2]) * 10.0f;
-        derivs[4] += sinf(state[2]) * 10.0f;
-    }
-}
+#define PlayerDrag   5.0f
+#define PlayerThrust 10.0f
+#define PlayerTurn   10.0f
 
 static void handleInput(gameComponentT* component, float dt) {
     playerEntityDataT* player = component->entity->data;
 
+    bodyT* body = ((physicsComponentDataT*)component->data)->body;
 
+    float thrust = 0.0f, turn = 0.0f;
 
-    graphicsComponentDataT* gfx = getComponent(component->entity, "graphics")->data;
-    bodyT* body = ((physicsComponentDataT*)component->data)->body;
+    if (keyIsPressed(ArrowLeft )) turn += PlayerTurn;
+    if (keyIsPressed(ArrowRight)) turn -= PlayerTurn;
+    if (keyIsPressed(ArrowUp   )) thrust = PlayerThrust;
 
-    mat_rot_z(bodyOrientation(body) - 90.0f*3.1415f / 180.0f, &gfx->transform);
+    bodySetThrust(body, thrust, turn);
 }
 
 gameEntityT* newPlayerEntity(void) {
@@ -69,11 +42,21 @@ gameEntityT* newPlayerEntity(void) {
     graphicsComponentDataT* gfx_data = gfx->data;
     assert(gfx_data->material != NULL);
 
+    // The mesh was made for this entity alone.
+    gfx_data->owns_mesh = true;
+
+    // The graphics subsystem rotates the mesh by the body orientation, so we
+    // only need to turn the mesh to face along the x axis. Doing it here
+    // rather than in handleInput() keeps the physics components out of the
+    // graphics data, so the two can be updated at the same time.
+    mat_rot_z(-90.0f*3.1415f / 180.0f, &gfx_data->transform);
+
     gameComponentT* phys = newPhysicsComponent(1.0f);
     phys->update_fn = handleInput;
 
     physicsComponentDataT* phys_data = phys->data;
-    bodySetDerivativeFn(phys_data->body, playerDerivativeFn);
+    bodySetForceModel(phys_data->body, ThrustModel);
+    bodySetDrag      (phys_data->body, PlayerDrag, PlayerDrag);
 
     attachComponent(entity, gfx);
     attachComponent(entity, phys);
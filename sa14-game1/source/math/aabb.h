@@ -1,6 +1,7 @@
 #ifndef aabb_h_
 #define aabb_h_
 
+#include "base/common.h"
 #include "math/vector.h"
 
 /*------------------------------------------------
@@ -12,4 +13,19 @@ typedef struct {
     vec2 max;
 } aabbT;
 
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static inline bool aabbOverlap(const aabbT* a, const aabbT* b) {
+    return (a->min.x <= b->max.x && a->max.x >= b->min.x
+         && a->min.y <= b->max.y && a->max.y >= b->min.y);
+}
+
+// Returns true if b lies inside a, at least margin away from its edges.
+static inline bool aabbContains(const aabbT* a, const aabbT* b, float margin) {
+    return (b->min.x > a->min.x + margin && b->max.x < a->max.x - margin
+         && b->min.y > a->min.y + margin && b->max.y < a->max.y - margin);
+}
+
 #endif
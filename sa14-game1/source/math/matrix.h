@@ -21,6 +21,7 @@
  *----------------------------------------------*/
 
 #include "base/common.h"
+#include "math/trig.h"
 #include "math/vector.h"
 
 #include <math.h>
@@ -180,8 +181,10 @@ static inline void mat_rot_y_(float a, float* m, int n) {
 static inline void mat_rot_z_(float a, float* m, int n) {
     mat_identity_(m, n);
 
-    float cos_a = cosf(a);
-    float sin_a = sinf(a);
+    // Used by the physics, so it goes through trig_sincos() to stay
+    // deterministic when DETERMINISTIC_PHYSICS is defined.
+    float cos_a, sin_a;
+    trig_sincos(a, &sin_a, &cos_a);
 
     m[  0] =  cos_a;
     m[  1] = -sin_a;
@@ -5,37 +5,202 @@
 #include "math/vector.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+// The initial number of buckets in the interned shape table. Must be a power
+// of two.
+#define InitialInternBuckets (64)
+
+static shapeT** intern_buckets;
+static int      num_intern_buckets;
+static int      num_interned;
 
 shapeT* shapeNew(int num_points) {
-    assert(0 <= num_points && num_points < ShapeMaxPoints)
+    assert(0 < num_points && num_points <= ShapeMaxPoints);
 
-    // One point is included in sizeof(shapeT) so we can subtract it.
-    shapeT* shape = calloc(1, sizeof(shapeT) + sizeof(vec2) * num_points-1);
+    // One point is included in sizeof(shapeT) so we can subtract it. The edge
+    // normals are stored right after the points, in the same memory block.
+    size_t size = sizeof(shapeT) + sizeof(vec2)*(num_points-1)
+                                 + sizeof(vec2)*num_points;
 
+    shapeT* shape = calloc(1, size);
+
+    shape->ref_count  = 1;
     shape->num_points = num_points;
+    shape->normals    = &shape->points[num_points];
 
     return (shape);
 }
 
-shapeT* shapeNewSquare(float width, float height) {
+static void squarePoints(float width, float height, vec2* points) {
     width  /= 2.0f;
     height /= 2.0f;
 
+    points[0] = (vec2) { .x =  width, .y =  height };
+    points[1] = (vec2) { .x = -width, .y =  height };
+    points[2] = (vec2) { .x = -width, .y = -height };
+    points[3] = (vec2) { .x =  width, .y = -height };
+}
+
+shapeT* shapeNewSquare(float width, float height) {
     shapeT* square = shapeNew(4);
 
-    square->points[0] = (vec2) {  width,  height };
-    square->points[1] = (vec2) { -width,  height };
-    square->points[2] = (vec2) { -width, -height };
-    square->points[3] = (vec2) {  width, -height };
+    squarePoints(width, height, square->points);
+    shapeUpdateNormals(square);
 
     return (square);
 }
 
+static unsigned int hashPoints(const vec2* points, int num_points) {
+    // FNV-1a over the bytes of the points. Points that compare equal but
+    // differ in their bits (like 0.0 and -0.0) end up as separate shapes,
+    // which is harmless.
+    const unsigned char* p = (const unsigned char*)points;
+    unsigned int         h = 2166136261u;
+
+    for (size_t i = 0; i < sizeof(vec2)*num_points; i++)
+        h = (h ^ p[i]) * 16777619u;
+
+    return (h);
+}
+
+static void growInternTable(void) {
+    int      num_buckets = max(num_intern_buckets*2, InitialInternBuckets);
+    shapeT** buckets     = calloc(num_buckets, sizeof(shapeT*));
+
+    for (int i = 0; i < num_intern_buckets; i++) {
+        shapeT* shape = intern_buckets[i];
+
+        while (shape) {
+            shapeT* next = shape->next_interned;
+            int     b    = shape->hash & (num_buckets-1);
+
+            shape->next_interned = buckets[b];
+            buckets[b]           = shape;
+
+            shape = next;
+        }
+    }
+
+    free(intern_buckets);
+
+    intern_buckets     = buckets;
+    num_intern_buckets = num_buckets;
+}
+
+shapeT* shapeIntern(const vec2* points, int num_points) {
+    unsigned int hash = hashPoints(points, num_points);
+
+    if (num_intern_buckets > 0) {
+        shapeT* shape = intern_buckets[hash & (num_intern_buckets-1)];
+
+        while (shape) {
+            if (shape->hash == hash && shape->num_points == num_points
+             && memcmp(shape->points, points, sizeof(vec2)*num_points) == 0)
+            {
+                return (shapeRetain(shape));
+            }
+
+            shape = shape->next_interned;
+        }
+    }
+
+    if (num_interned >= num_intern_buckets)
+        growInternTable();
+
+    shapeT* shape = shapeNew(num_points);
+
+    memcpy(shape->points, points, sizeof(vec2)*num_points);
+    shapeUpdateNormals(shape);
+
+    int b = hash & (num_intern_buckets-1);
+
+    shape->interned      = true;
+    shape->hash          = hash;
+    shape->next_interned = intern_buckets[b];
+    intern_buckets[b]    = shape;
+
+    num_interned++;
+
+    return (shape);
+}
+
+shapeT* shapeInternSquare(float width, float height) {
+    vec2 points[4];
+    squarePoints(width, height, points);
+
+    return (shapeIntern(points, 4));
+}
+
+shapeT* shapeRetain(shapeT* shape) {
+    shape->ref_count++;
+
+    return (shape);
+}
+
+static void removeInterned(shapeT* shape) {
+    shapeT** link = &intern_buckets[shape->hash & (num_intern_buckets-1)];
+
+    while (*link != shape)
+        link = &(*link)->next_interned;
+
+    *link = shape->next_interned;
+    num_interned--;
+
+    shape->interned = false;
+}
+
+void shapeRelease(shapeT* shape) {
+    if (!shape)
+        return;
+
+    assert(shape->ref_count > 0);
+
+    if (--shape->ref_count > 0)
+        return;
+
+    if (shape->interned)
+        removeInterned(shape);
+
+    shapeFree(shape);
+}
+
 void shapeFree(shapeT* shape) {
-    free(shape->points);
+    if (!shape)
+        return;
+
+    assert(!shape->interned);
+
+    // The points and normals are part of the same memory block as the shape.
     free(shape);
 }
 
+void shapeUpdateNormals(shapeT* shape) {
+    int n = shape->num_points;
+
+    // We need to know the winding order to know which way is outward, so we
+    // calculate the (doubled) signed area of the polygon.
+    float area = 0.0f;
+    for (int i = 0; i < n; i++) {
+        vec2* p = &shape->points[i];
+        vec2* q = &shape->points[(i+1) % n];
+
+        area += p->x*q->y - q->x*p->y;
+    }
+
+    float sign = (area >= 0.0f) ? 1.0f : -1.0f;
+
+    for (int i = 0; i < n; i++) {
+        vec2 e;
+        vec_sub(&shape->points[(i+1) % n], &shape->points[i], &e);
+
+        // For counter-clockwise polygons, the outward normal is the edge
+        // rotated 90 degrees clockwise.
+        shape->normals[i] = (vec2) { .x = sign*e.y, .y = -sign*e.x };
+        vec_normalize(&shape->normals[i], &shape->normals[i]);
+    }
+}
+
 aabbT shapeAABB(const shapeT* shape) {
     aabbT aabb = { 0 };
 
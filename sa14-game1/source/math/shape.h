@@ -7,14 +7,43 @@
 
 #define ShapeMaxPoints 256
 
-typedef struct {
-    int  num_points;
-    vec2 points[1];
+typedef struct shapeT {
+    int ref_count;
+
+    // Interned shapes are kept in a hash table, chained through next_interned.
+    bool           interned;
+    unsigned int   hash;
+    struct shapeT* next_interned;
+
+    int   num_points;
+    vec2* normals;   // Outward edge normals. normals[i] belongs to the edge
+                     // going from points[i] to points[i+1].
+    vec2  points[1];
 } shapeT;
 
+// Shapes are reference counted. A new shape starts out with one reference,
+// which belongs to the caller.
 shapeT* shapeNew(int num_points);
 shapeT* shapeNewSquare(float width, float height);
 
+// Returns the shared shape with the specified points, creating it the first
+// time it is asked for, so that bodies with the same geometry share a single
+// shape. The caller gets a reference and must release it. The returned shape
+// must not be changed. Not thread-safe.
+shapeT* shapeIntern(const vec2* points, int num_points);
+shapeT* shapeInternSquare(float width, float height);
+
+shapeT* shapeRetain(shapeT* shape);
+
+// Drops a reference to the shape, freeing it when it was the last one.
+void shapeRelease(shapeT* shape);
+
+// Recalculates the edge normals. Must be called after the shape points have
+// been changed.
+void shapeUpdateNormals(shapeT* shape);
+
+// Frees the shape regardless of its references. Must not be used on interned
+// shapes.
 void shapeFree(shapeT* shape);
 
 aabbT shapeAABB(const shapeT* shape);
@@ -0,0 +1,98 @@
+#ifndef trig_h_
+#define trig_h_
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include <float.h>
+#include <math.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// Define DETERMINISTIC_PHYSICS (make DETERMINISTIC=1) to get bit-identical
+// physics across compilers, optimization levels and SSE/scalar code. Besides
+// the trig functions below, that needs every float operation to be rounded to
+// float exactly where the code says so: no fused multiply-adds (the Makefile
+// passes -ffp-contract=off), no reordering (-ffast-math) and no excess x87
+// precision. The last two we can check for here.
+#ifdef DETERMINISTIC_PHYSICS
+
+#ifdef __FAST_MATH__
+#error "DETERMINISTIC_PHYSICS does not work with -ffast-math"
+#endif // __FAST_MATH__
+
+// 16 means _Float16 math is done in float, which leaves float itself alone.
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0 && FLT_EVAL_METHOD != 16
+#error "DETERMINISTIC_PHYSICS needs float math done in float (SSE2) precision"
+#endif // FLT_EVAL_METHOD
+
+#endif // DETERMINISTIC_PHYSICS
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+#ifdef DETERMINISTIC_PHYSICS
+
+static inline void trig_sincos(float a, float* s, float* c) {
+    // sinf() and cosf() differ between C libraries, and compilers are free to
+    // replace them with their own versions, so we use our own. The angle is
+    // brought into [-pi/4, pi/4] and then plugged into the minimax
+    // polynomials from Cephes, which are good to about one ulp. pi/2 is split
+    // in three parts so the reduction stays accurate for larger angles.
+    float q = floorf(a*0.63661977f + 0.5f); // a / (pi/2), rounded.
+    float r = a - q*1.5703125f;
+    r = r - q*4.8375129699707031e-4f;
+    r = r - q*7.5497899548918821e-8f;
+
+    float r2 = r*r;
+
+    float sr = -1.9515295891e-4f;
+    sr = sr*r2 + 8.3321608736e-3f;
+    sr = sr*r2 - 1.6666654611e-1f;
+    sr = sr*r2*r + r;
+
+    float cr = 2.443315711809948e-5f;
+    cr = cr*r2 - 1.388731625493765e-3f;
+    cr = cr*r2 + 4.166664568298827e-2f;
+    cr = cr*r2*r2 - 0.5f*r2 + 1.0f;
+
+    // The quadrant decides which polynomial gives which function, and the
+    // signs. fmodf() is exact, so this is safe too.
+    int quadrant = (int)fmodf(q, 4.0f);
+    if (quadrant < 0)
+        quadrant += 4;
+
+    switch (quadrant) {
+    case 0: *s =  sr; *c =  cr; break;
+    case 1: *s =  cr; *c = -sr; break;
+    case 2: *s = -sr; *c = -cr; break;
+    case 3: *s = -cr; *c =  sr; break;
+    }
+}
+
+#else
+
+static inline void trig_sincos(float a, float* s, float* c) {
+    *s = sinf(a);
+    *c = cosf(a);
+}
+
+#endif // DETERMINISTIC_PHYSICS
+
+static inline float trig_sin(float a) {
+    float s, c;
+    trig_sincos(a, &s, &c);
+    return (s);
+}
+
+static inline float trig_cos(float a) {
+    float s, c;
+    trig_sincos(a, &s, &c);
+    return (c);
+}
+
+#endif // trig_h_
@@ -0,0 +1,498 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "aabbtree.h"
+
+#include "base/common.h"
+#include "base/debug.h"
+#include "math/aabb.h"
+#include "math/vector.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// Marks missing nodes, like the children of leaves.
+#define NullNode (-1)
+
+// How much the AABBs of proxies are enlarged on each side.
+#define AABBMargin (0.1f)
+
+// The tree is kept balanced, so its height stays around log2 of the number of
+// proxies. This is enough for any number of proxies we'll ever have.
+#define MaxStackSize 256
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct {
+    aabbT aabb;
+
+    int parent; // Also links free nodes together.
+    int child1; // NullNode for leaves.
+    int child2;
+    int height; // Zero for leaves, -1 for free nodes.
+    int id;     // The id of the object behind a leaf.
+} treeNodeT;
+
+struct aabbTreeT {
+    treeNodeT* nodes;
+    int        max_nodes;
+    int        root;
+    int        free_nodes;
+};
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static aabbT combineAABBs(const aabbT* a, const aabbT* b) {
+    return ((aabbT) { { .x = min(a->min.x, b->min.x),
+                        .y = min(a->min.y, b->min.y) },
+                      { .x = max(a->max.x, b->max.x),
+                        .y = max(a->max.y, b->max.y) } });
+}
+
+static float perimeter(const aabbT* aabb) {
+    return (2.0f*((aabb->max.x - aabb->min.x) + (aabb->max.y - aabb->min.y)));
+}
+
+static bool isLeaf(const treeNodeT* node) {
+    return (node->child1 == NullNode);
+}
+
+static int allocNode(aabbTreeT* tree) {
+    if (tree->free_nodes == NullNode) {
+        int old_max = tree->max_nodes;
+
+        tree->max_nodes = max(16, 2*old_max);
+        tree->nodes     = realloc(tree->nodes,
+                                  tree->max_nodes * sizeof(treeNodeT));
+
+        for (int i = tree->max_nodes-1; i >= old_max; i--) {
+            tree->nodes[i].parent = tree->free_nodes;
+            tree->nodes[i].height = -1;
+            tree->free_nodes      = i;
+        }
+    }
+
+    int        i    = tree->free_nodes;
+    treeNodeT* node = &tree->nodes[i];
+
+    tree->free_nodes = node->parent;
+
+    node->parent = NullNode;
+    node->child1 = NullNode;
+    node->child2 = NullNode;
+    node->height = 0;
+    node->id     = -1;
+
+    return (i);
+}
+
+static void freeNode(aabbTreeT* tree, int i) {
+    tree->nodes[i].parent = tree->free_nodes;
+    tree->nodes[i].height = -1;
+    tree->free_nodes      = i;
+}
+
+static void refitNode(aabbTreeT* tree, int i) {
+    treeNodeT*       node = &tree->nodes[i];
+    const treeNodeT* a    = &tree->nodes[node->child1];
+    const treeNodeT* b    = &tree->nodes[node->child2];
+
+    node->aabb   = combineAABBs(&a->aabb, &b->aabb);
+    node->height = 1 + max(a->height, b->height);
+}
+
+static void replaceChild(aabbTreeT* tree, int parent, int old_child,
+                         int new_child)
+{
+    if (parent == NullNode) {
+        tree->root = new_child;
+        return;
+    }
+
+    treeNodeT* node = &tree->nodes[parent];
+
+    if (node->child1 == old_child)
+        node->child1 = new_child;
+    else
+        node->child2 = new_child;
+}
+
+static int rotateUp(aabbTreeT* tree, int a, int c, bool c_is_child2) {
+    // Makes c (a child of a, two levels taller than its sibling) take the
+    // place of a. The taller child of c stays with c and the other one goes to
+    // a, in c's old place.
+    treeNodeT* node_a = &tree->nodes[a];
+    treeNodeT* node_c = &tree->nodes[c];
+
+    int f = node_c->child1;
+    int g = node_c->child2;
+
+    node_c->child1 = a;
+    node_c->parent = node_a->parent;
+    node_a->parent = c;
+
+    replaceChild(tree, node_c->parent, a, c);
+
+    int keep = f, move = g;
+    if (tree->nodes[g].height > tree->nodes[f].height) {
+        keep = g;
+        move = f;
+    }
+
+    node_c->child2 = keep;
+
+    if (c_is_child2)
+        node_a->child2 = move;
+    else
+        node_a->child1 = move;
+
+    tree->nodes[move].parent = a;
+
+    refitNode(tree, a);
+    refitNode(tree, c);
+
+    return (c);
+}
+
+static int balance(aabbTreeT* tree, int a) {
+    // Does an AVL rotation at node a if one of its subtrees has grown too
+    // tall, and returns the node that takes its place.
+    const treeNodeT* node_a = &tree->nodes[a];
+
+    if (isLeaf(node_a) || node_a->height < 2)
+        return (a);
+
+    int b = node_a->child1;
+    int c = node_a->child2;
+    int d = tree->nodes[c].height - tree->nodes[b].height;
+
+    if (d > 1)
+        return (rotateUp(tree, a, c, true));
+
+    if (d < -1)
+        return (rotateUp(tree, a, b, false));
+
+    return (a);
+}
+
+static void fixUpwards(aabbTreeT* tree, int i) {
+    while (i != NullNode) {
+        i = balance(tree, i);
+        refitNode(tree, i);
+        i = tree->nodes[i].parent;
+    }
+}
+
+static void insertLeaf(aabbTreeT* tree, int leaf) {
+    if (tree->root == NullNode) {
+        tree->root = leaf;
+        tree->nodes[leaf].parent = NullNode;
+        return;
+    }
+
+    // Walk down the tree, picking the child that grows the least (by
+    // perimeter) from taking the leaf, until it's cheaper to put the leaf next
+    // to the current node than to go further down.
+    aabbT aabb  = tree->nodes[leaf].aabb;
+    int   index = tree->root;
+
+    while (!isLeaf(&tree->nodes[index])) {
+        const treeNodeT* node = &tree->nodes[index];
+
+        float area          = perimeter(&node->aabb);
+        aabbT combined      = combineAABBs(&node->aabb, &aabb);
+        float combined_area = perimeter(&combined);
+
+        float cost        = 2.0f*combined_area;
+        float inheritance = 2.0f*(combined_area - area);
+
+        float child_cost[2];
+        int   children[2] = { node->child1, node->child2 };
+
+        for (int i = 0; i < 2; i++) {
+            const treeNodeT* child = &tree->nodes[children[i]];
+            aabbT            c     = combineAABBs(&child->aabb, &aabb);
+
+            child_cost[i] = perimeter(&c) + inheritance;
+            if (!isLeaf(child))
+                child_cost[i] -= perimeter(&child->aabb);
+        }
+
+        if (cost < child_cost[0] && cost < child_cost[1])
+            break;
+
+        index = (child_cost[0] < child_cost[1]) ? children[0] : children[1];
+    }
+
+    int sibling    = index;
+    int old_parent = tree->nodes[sibling].parent;
+    int new_parent = allocNode(tree);
+
+    treeNodeT* node = &tree->nodes[new_parent];
+
+    node->parent = old_parent;
+    node->child1 = sibling;
+    node->child2 = leaf;
+
+    tree->nodes[sibling].parent = new_parent;
+    tree->nodes[leaf   ].parent = new_parent;
+
+    replaceChild(tree, old_parent, sibling, new_parent);
+    fixUpwards(tree, new_parent);
+}
+
+static void removeLeaf(aabbTreeT* tree, int leaf) {
+    if (leaf == tree->root) {
+        tree->root = NullNode;
+        return;
+    }
+
+    int parent = tree->nodes[leaf].parent;
+    int grand  = tree->nodes[parent].parent;
+
+    int sibling = tree->nodes[parent].child1;
+    if (sibling == leaf)
+        sibling = tree->nodes[parent].child2;
+
+    replaceChild(tree, grand, parent, sibling);
+    tree->nodes[sibling].parent = grand;
+
+    freeNode(tree, parent);
+    fixUpwards(tree, grand);
+}
+
+aabbTreeT* aabbTreeNew(void) {
+    aabbTreeT* tree = calloc(1, sizeof(aabbTreeT));
+
+    tree->root       = NullNode;
+    tree->free_nodes = NullNode;
+
+    return (tree);
+}
+
+void aabbTreeFree(aabbTreeT* tree) {
+    if (!tree)
+        return;
+
+    free(tree->nodes);
+    free(tree);
+}
+
+int aabbTreeInsert(aabbTreeT* tree, const aabbT* aabb, int id) {
+    int        proxy = allocNode(tree);
+    treeNodeT* node  = &tree->nodes[proxy];
+
+    node->aabb = (aabbT) { { .x = aabb->min.x - AABBMargin,
+                             .y = aabb->min.y - AABBMargin },
+                           { .x = aabb->max.x + AABBMargin,
+                             .y = aabb->max.y + AABBMargin } };
+    node->id   = id;
+
+    insertLeaf(tree, proxy);
+
+    return (proxy);
+}
+
+void aabbTreeRemove(aabbTreeT* tree, int proxy) {
+    assert(isLeaf(&tree->nodes[proxy]));
+
+    removeLeaf(tree, proxy);
+    freeNode(tree, proxy);
+}
+
+void aabbTreeMove(aabbTreeT* tree, int proxy, const aabbT* aabb) {
+    treeNodeT* node = &tree->nodes[proxy];
+
+    if (aabbContains(&node->aabb, aabb, 0.0f))
+        return;
+
+    removeLeaf(tree, proxy);
+
+    node->aabb = (aabbT) { { .x = aabb->min.x - AABBMargin,
+                             .y = aabb->min.y - AABBMargin },
+                           { .x = aabb->max.x + AABBMargin,
+                             .y = aabb->max.y + AABBMargin } };
+
+    insertLeaf(tree, proxy);
+}
+
+void aabbTreeQuery(const aabbTreeT* tree, const aabbT* aabb,
+                   aabbTreeQueryFnT fn, void* data)
+{
+    if (tree->root == NullNode)
+        return;
+
+    int stack[MaxStackSize];
+    int num_stack = 0;
+
+    stack[num_stack++] = tree->root;
+
+    while (num_stack > 0) {
+        const treeNodeT* node = &tree->nodes[stack[--num_stack]];
+
+        if (!aabbOverlap(&node->aabb, aabb))
+            continue;
+
+        if (isLeaf(node)) {
+            if (!fn(data, node->id))
+                return;
+
+            continue;
+        }
+
+        assert(num_stack+2 <= MaxStackSize);
+        stack[num_stack++] = node->child1;
+        stack[num_stack++] = node->child2;
+    }
+}
+
+static bool rayHitsAABB(vec2 p, vec2 d, const aabbT* aabb, float max_t,
+                        float* t)
+{
+    // Clips the ray against the x and y slabs of the AABB. Returns the
+    // distance at which the ray enters the box in t.
+    float t0 = 0.0f, t1 = max_t;
+
+    float pos[2] = { p.x, p.y };
+    float dir[2] = { d.x, d.y };
+    float lo [2] = { aabb->min.x, aabb->min.y };
+    float hi [2] = { aabb->max.x, aabb->max.y };
+
+    for (int i = 0; i < 2; i++) {
+        if (dir[i] == 0.0f) {
+            if (pos[i] < lo[i] || pos[i] > hi[i])
+                return (false);
+
+            continue;
+        }
+
+        float inv = 1.0f / dir[i];
+        float ta  = (lo[i] - pos[i]) * inv;
+        float tb  = (hi[i] - pos[i]) * inv;
+
+        t0 = max(t0, min(ta, tb));
+        t1 = min(t1, max(ta, tb));
+
+        if (t0 > t1)
+            return (false);
+    }
+
+    *t = t0;
+    return (true);
+}
+
+float aabbTreeRaycast(const aabbTreeT* tree, vec2 p, vec2 d, float max_t,
+                      aabbTreeRayFnT fn, void* data)
+{
+    if (tree->root == NullNode)
+        return (max_t);
+
+    int stack[MaxStackSize];
+    int num_stack = 0;
+
+    stack[num_stack++] = tree->root;
+
+    while (num_stack > 0) {
+        const treeNodeT* node = &tree->nodes[stack[--num_stack]];
+
+        float t;
+        if (!rayHitsAABB(p, d, &node->aabb, max_t, &t))
+            continue;
+
+        if (isLeaf(node)) {
+            max_t = fn(data, node->id, max_t);
+            continue;
+        }
+
+        // The child that the ray gets to first is pushed last, so that it's
+        // visited first and hits in it cut the ray short sooner.
+        int   a = node->child1, b = node->child2;
+        float ta, tb;
+
+        bool hit_a = rayHitsAABB(p, d, &tree->nodes[a].aabb, max_t, &ta);
+        bool hit_b = rayHitsAABB(p, d, &tree->nodes[b].aabb, max_t, &tb);
+
+        assert(num_stack+2 <= MaxStackSize);
+
+        if (hit_a && hit_b) {
+            stack[num_stack++] = (ta < tb) ? b : a;
+            stack[num_stack++] = (ta < tb) ? a : b;
+        }
+        else if (hit_a) {
+            stack[num_stack++] = a;
+        }
+        else if (hit_b) {
+            stack[num_stack++] = b;
+        }
+    }
+
+    return (max_t);
+}
+
+static float distanceToAABB(vec2 p, const aabbT* aabb) {
+    float dx = max(max(aabb->min.x - p.x, p.x - aabb->max.x), 0.0f);
+    float dy = max(max(aabb->min.y - p.y, p.y - aabb->max.y), 0.0f);
+
+    return (sqrtf(dx*dx + dy*dy));
+}
+
+int aabbTreeNearest(const aabbTreeT* tree, vec2 p, float max_dist,
+                    aabbTreeDistanceFnT fn, void* data, float* dist)
+{
+    // Branch and bound: the distance to a node AABB is a lower bound of the
+    // distance to anything in it, so we skip the nodes that can't beat the
+    // best distance so far.
+    int   best_id   = -1;
+    float best_dist = max_dist;
+
+    if (tree->root == NullNode)
+        return (-1);
+
+    int stack[MaxStackSize];
+    int num_stack = 0;
+
+    stack[num_stack++] = tree->root;
+
+    while (num_stack > 0) {
+        const treeNodeT* node = &tree->nodes[stack[--num_stack]];
+
+        if (distanceToAABB(p, &node->aabb) >= best_dist)
+            continue;
+
+        if (isLeaf(node)) {
+            float d = fn(data, node->id, best_dist);
+
+            if (d < best_dist) {
+                best_dist = d;
+                best_id   = node->id;
+            }
+
+            continue;
+        }
+
+        // Visit the closer child first.
+        int a = node->child1, b = node->child2;
+
+        float da = distanceToAABB(p, &tree->nodes[a].aabb);
+        float db = distanceToAABB(p, &tree->nodes[b].aabb);
+
+        assert(num_stack+2 <= MaxStackSize);
+        stack[num_stack++] = (da < db) ? b : a;
+        stack[num_stack++] = (da < db) ? a : b;
+    }
+
+    if (dist && best_id >= 0)
+        *dist = best_dist;
+
+    return (best_id);
+}
@@ -0,0 +1,67 @@
+#ifndef aabbtree_h_
+#define aabbtree_h_
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/common.h"
+#include "math/aabb.h"
+#include "math/vector.h"
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+// A dynamic AABB tree (a bounding volume hierarchy that's updated as things
+// move). Each proxy is stored with an AABB that's a bit bigger than the one it
+// was given, so that small movements don't change the tree at all.
+typedef struct aabbTreeT aabbTreeT;
+
+// Called with the id of each proxy that a query finds. Returning false stops
+// the query.
+typedef bool (*aabbTreeQueryFnT)(void* data, int id);
+
+// Called with the id of each proxy that a ray passes through, and the
+// distance along the ray to stop at. Returns the new distance to stop at,
+// which is the distance to the hit if the ray hits the object behind the
+// proxy, and max_t otherwise.
+typedef float (*aabbTreeRayFnT)(void* data, int id, float max_t);
+
+// Called with the id of each proxy that could be closer than max_dist to the
+// query point. Returns the actual distance to the object behind the proxy.
+typedef float (*aabbTreeDistanceFnT)(void* data, int id, float max_dist);
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+aabbTreeT* aabbTreeNew(void);
+void aabbTreeFree(aabbTreeT* tree);
+
+// Adds a proxy for the object with the specified id and returns it.
+int aabbTreeInsert(aabbTreeT* tree, const aabbT* aabb, int id);
+void aabbTreeRemove(aabbTreeT* tree, int proxy);
+
+// Updates the AABB of a proxy. The tree is only changed when the new AABB is
+// no longer inside the enlarged one that's stored for the proxy.
+void aabbTreeMove(aabbTreeT* tree, int proxy, const aabbT* aabb);
+
+// Calls fn for every proxy whose (enlarged) AABB overlaps the specified one.
+void aabbTreeQuery(const aabbTreeT* tree, const aabbT* aabb,
+                   aabbTreeQueryFnT fn, void* data);
+
+// Calls fn for every proxy along the ray from p in direction d (which doesn't
+// need to be normalized) up to p + d*max_t, nearest first as far as the tree
+// can tell. Proxies beyond the distance returned by fn are skipped. Returns
+// the final distance.
+float aabbTreeRaycast(const aabbTreeT* tree, vec2 p, vec2 d, float max_t,
+                      aabbTreeRayFnT fn, void* data);
+
+// Finds the proxy whose object is nearest to p and closer than max_dist, as
+// measured by fn, and returns its id, or -1 if there is none. The distance is
+// stored in dist if it's not NULL.
+int aabbTreeNearest(const aabbTreeT* tree, vec2 p, float max_dist,
+                    aabbTreeDistanceFnT fn, void* data, float* dist);
+
+#endif // aabbtree_h_
@@ -2,41 +2,28 @@
 #include "body.h"
 
 #include "base/common.h"
+#include "base/pool.h"
 #include "math/aabb.h"
 #include "math/matrix.h"
 #include "math/shape.h"
 #include "math/vector.h"
 
+#include <float.h>
 #include <stdlib.h>
 #include <string.h>
 
-// This is the default derivatives function which applies no extra forces.
-static void derivativeFn(const float* state, float* derivs) {
-    // state[0] = x.x
-    // state[1] = x.y
-    // state[2] = o
-    // state[3] = v.x
-    // state[4] = v.y
-    // state[5] = w
+// The number of bodies allocated from the heap at a time.
+#define BodiesPerChunk (256)
 
-    // derivs[0] = v.x
-    // derivs[1] = v.y
-    // derivs[2] = w
-    // derivs[3] = a.x
-    // derivs[4] = a.y
-    // derivs[5] = t
-
-    derivs[0] = state[3];
-    derivs[1] = state[4];
-    derivs[2] = state[5];
-
-    derivs[3] = 0.0f;
-    derivs[4] = 0.0f;
-    derivs[5] = 0.0f;
-}
+// All bodies come from the same pool, so spawning and removing bodies doesn't
+// go through the heap once the pool has grown large enough.
+static poolT* body_pool;
 
 static bodyT* bodyAlloc(void) {
-    bodyT* body = malloc(sizeof(bodyT));
+    if (!body_pool)
+        body_pool = poolNew(sizeof(bodyT), BodiesPerChunk);
+
+    bodyT* body = poolAlloc(body_pool);
 
     return (body);
 }
@@ -44,12 +31,13 @@ static bodyT* bodyAlloc(void) {
 static void bodyInit(bodyT* body, shapeT* shape, float mass) {
     memset(body, 0, sizeof(bodyT));
 
-    body->shape       = shape;
+    body->id          = -1;
+    body->shape       = shapeRetain(shape);
     body->inv_mass    = 1.0f/mass;
     body->inv_inertia = 1.0f / 0.015f;
     body->restitution = 1.0f;
     body->type        = DynamicBody;
-    body->deriv_fn    = derivativeFn;
+    body->force_model = BallisticModel;
 }
 
 bodyT* bodyNew(shapeT* shape, float mass) {
@@ -61,30 +49,39 @@ bodyT* bodyNew(shapeT* shape, float mass) {
 
 bodyT* bodyNewSquare(float width, float height, float mass) {
     // @To-do: Remove this function. Up to the client to provide a shape.
-    shapeT* shape = shapeNewSquare(width, height);
+    shapeT* shape = shapeInternSquare(width, height);
+    bodyT*  body  = bodyNew(shape, mass);
+
+    shapeRelease(shape);
 
-    return (bodyNew(shape, mass));
+    return (body);
 }
 
 void bodyFree(bodyT* body) {
-    if (body)
-        free(body);
+    if (!body)
+        return;
+
+    shapeRelease(body->shape);
+    poolRelease(body_pool, body);
 }
 
 aabbT bodyAABB(const bodyT* body) {
     aabbT aabb = shapeAABB(body->shape);
+    vec2  pos  = bodyPosition(body);
 
-    vec_add(&body->state.x, &aabb.min, &aabb.min);
-    vec_add(&body->state.x, &aabb.max, &aabb.max);
+    vec_add(&pos, &aabb.min, &aabb.min);
+    vec_add(&pos, &aabb.max, &aabb.max);
 
     return (aabb);
 }
 
 aabbT bodyRotatedAABB(const bodyT* body) {
-    aabbT aabb = { 0 };
+    aabbT aabb = { { .x =  FLT_MAX, .y =  FLT_MAX },
+                   { .x = -FLT_MAX, .y = -FLT_MAX } };
+    vec2  pos  = bodyPosition(body);
 
     mat2x2 r;
-    mat_rot_z(body->state.o, &r);
+    mat_rot_z(bodyOrientation(body), &r);
 
     for (int i = 0; i < body->shape->num_points; i++) {
         vec2 p = body->shape->points[i];
@@ -96,45 +93,259 @@ aabbT bodyRotatedAABB(const bodyT* body) {
         aabb.max.y = max(aabb.max.y, p.y);
     }
 
-    vec_add(&body->state.x, &aabb.min, &aabb.min);
-    vec_add(&body->state.x, &aabb.max, &aabb.max);
+    vec_add(&pos, &aabb.min, &aabb.min);
+    vec_add(&pos, &aabb.max, &aabb.max);
 
     return (aabb);
 }
 
-float bodyOrientation   (const bodyT* body)              { return (body->state.o); }
-void  bodySetOrientation(      bodyT* body, float angle) { body->state.o = angle;  }
+// While a body is not in a world, its state is kept in the body itself. The
+// functions below read and write the world body arrays otherwise.
+
+float bodyOrientation(const bodyT* body) {
+    if (!body->world)
+        return (body->state.o);
+
+    return (body->world->state.o[body->id]);
+}
+
+void bodySetOrientation(bodyT* body, float angle) {
+    if (!body->world) {
+        body->state.o = angle;
+        return;
+    }
+
+    // Setting the orientation directly is a jump, not something to draw in
+    // between steps.
+    body->world->state.o[body->id] = angle;
+    body->world->start_o[body->id] = angle;
+
+    worldMoveProxy(body->world, body->id);
+
+    // A body that is moved by hand may now overlap something, which only
+    // gets resolved while it's awake.
+    worldWakeBody(body->world, body->id);
+}
+
+float bodyPrevOrientation(const bodyT* body) {
+    if (!body->world)
+        return (body->state.o);
+
+    return (body->world->start_o[body->id]);
+}
+
+float bodyMass(const bodyT* body) {
+    return (1.0f/body->inv_mass);
+}
+
+void bodySetMass(bodyT* body, float mass) {
+    body->inv_mass = 1.0f/mass;
 
-float bodyMass   (const bodyT* body)             { return (1.0f/body->inv_mass); }
-void  bodySetMass(      bodyT* body, float mass) { body->inv_mass = 1.0f/mass;   }
+    if (body->world && body->type != StaticBody)
+        body->world->inv_mass[body->id] = body->inv_mass;
+}
+
+vec2 bodyPosition(const bodyT* body) {
+    if (!body->world)
+        return (body->state.x);
+
+    const worldT* world = body->world;
+    int           i     = body->id;
+
+    return ((vec2) { .x = world->state.x[i], .y = world->state.y[i] });
+}
+
+void bodySetPosition(bodyT* body, vec2 pos) {
+    if (!body->world) {
+        body->state.x = pos;
+        return;
+    }
+
+    body->world->state.x[body->id] = pos.x;
+    body->world->state.y[body->id] = pos.y;
+    body->world->start_x[body->id] = pos.x;
+    body->world->start_y[body->id] = pos.y;
+
+    worldMoveProxy(body->world, body->id);
+    worldWakeBody (body->world, body->id);
+}
+
+vec2 bodyPrevPosition(const bodyT* body) {
+    if (!body->world)
+        return (body->state.x);
 
-vec2 bodyPosition   (const bodyT* body)           { return (body->state.x); }
-void bodySetPosition(      bodyT* body, vec2 pos) { body->state.x = pos;    }
+    const worldT* world = body->world;
+    int           i     = body->id;
 
-bodyTypeT bodyType   (const bodyT* body)           { return (body->type); }
-void      bodySetType(      bodyT* body, int type) { body->type = type;   }
+    return ((vec2) { .x = world->start_x[i], .y = world->start_y[i] });
+}
+
+bodyTypeT bodyType(const bodyT* body) {
+    return (body->type);
+}
 
-vec2 bodyVelocity   (const bodyT* body)           { return (body->state.v); }
-void bodySetVelocity(      bodyT* body, vec2 vel) { body->state.v = vel;    }
+void bodySetType(bodyT* body, int type) {
+    body->type = type;
+
+    if (!body->world)
+        return;
+
+    worldT* world = body->world;
+    int     id    = body->id;
+
+    if (type == StaticBody) {
+        // Static bodies have infinite mass and never move, so they are put to
+        // sleep for good.
+        world->inv_mass   [id] = 0.0f;
+        world->inv_inertia[id] = 0.0f;
+        world->state.vx   [id] = 0.0f;
+        world->state.vy   [id] = 0.0f;
+        world->state.w    [id] = 0.0f;
+        world->awake      [id] = false;
+        return;
+    }
+
+    world->inv_mass   [id] = body->inv_mass;
+    world->inv_inertia[id] = body->inv_inertia;
+    worldWakeBody(world, id);
+}
+
+bool bodyIsSleeping(const bodyT* body) {
+    if (!body->world)
+        return (false);
+
+    return (!body->world->awake[body->id]);
+}
+
+bool bodyIsCCD(const bodyT* body) {
+    return (body->ccd);
+}
 
-void bodySetDerivativeFn(bodyT* body, void (*deriv_fn)(void)) {
+void bodySetCCD(bodyT* body, bool ccd) {
+    body->ccd = ccd;
+
+    if (body->world)
+        body->world->ccd[body->id] = ccd;
+}
+
+vec2 bodyVelocity(const bodyT* body) {
+    if (!body->world)
+        return (body->state.v);
+
+    const worldT* world = body->world;
+    int           i     = body->id;
+
+    return ((vec2) { .x = world->state.vx[i], .y = world->state.vy[i] });
+}
+
+void bodySetVelocity(bodyT* body, vec2 vel) {
+    if (!body->world) {
+        body->state.v = vel;
+        return;
+    }
+
+    if (body->type == StaticBody)
+        return;
+
+    body->world->state.vx[body->id] = vel.x;
+    body->world->state.vy[body->id] = vel.y;
+
+    worldWakeBody(body->world, body->id);
+}
+
+forceModelT bodyForceModel(const bodyT* body) {
+    return (body->force_model);
+}
+
+void bodySetForceModel(bodyT* body, forceModelT model) {
+    assert(model >= 0 && model < NumForceModels);
+    assert(model != CustomModel || body->deriv_fn != NULL);
+
+    body->force_model = model;
+
+    if (body->world)
+        body->world->force_models[body->id] = model;
+}
+
+static void updateForceParams(bodyT* body) {
+    if (body->world)
+        body->world->force_params[body->id] = body->force_params;
+}
+
+void bodySetDrag(bodyT* body, float linear, float angular) {
+    body->force_params.drag         = linear;
+    body->force_params.angular_drag = angular;
+
+    updateForceParams(body);
+}
+
+void bodySetThrust(bodyT* body, float thrust, float turn) {
+    body->force_params.thrust = thrust;
+    body->force_params.turn   = turn;
+
+    updateForceParams(body);
+
+    // Sleeping bodies aren't integrated, and a body under thrust shouldn't be
+    // put to sleep either.
+    if (body->world && (thrust != 0.0f || turn != 0.0f))
+        worldWakeBody(body->world, body->id);
+}
+
+void bodySetDerivativeFn(bodyT* body, derivativeFnT deriv_fn) {
     body->deriv_fn = deriv_fn;
+
+    if (body->world)
+        body->world->deriv_fns[body->id] = deriv_fn;
+
+    bodySetForceModel(body, deriv_fn ? CustomModel : BallisticModel);
 }
 
 void bodyApplyForce(bodyT* body, vec2 f, vec2 p) {
     vec_scale(&f, body->inv_mass, &f);
-    vec_add  (&body->state.a, &f, &body->state.a);
+
+    if (!body->world) {
+        vec_add(&body->state.a, &f, &body->state.a);
+        return;
+    }
+
+    body->world->ax[body->id] += f.x;
+    body->world->ay[body->id] += f.y;
+
+    worldWakeBody(body->world, body->id);
 }
 
 void bodyApplyImpulse(bodyT* body, vec2 i, vec2 p) {
     vec2 a = i;
     vec_scale(&a, body->inv_mass, &a);
-    vec_add  (&a, &body->state.v, &body->state.v);
 
-    float b = vec_perp_dot(&p, &i);
-    body->state.w += b * body->inv_inertia;
+    float b = vec_perp_dot(&p, &i) * body->inv_inertia;
+
+    if (!body->world) {
+        vec_add(&a, &body->state.v, &body->state.v);
+        body->state.w += b;
+        return;
+    }
+
+    worldT* world = body->world;
+    int     id    = body->id;
+
+    if (body->type == StaticBody)
+        return;
+
+    world->state.vx[id] += a.x;
+    world->state.vy[id] += a.y;
+    world->state.w [id] += b;
+
+    worldWakeBody(world, id);
 }
 
 void bodyApplyTorque(bodyT* body, float t) {
-    body->state.t += t;
+    if (!body->world) {
+        body->state.t += t;
+        return;
+    }
+
+    body->world->t[body->id] += t;
+
+    worldWakeBody(body->world, body->id);
 }
@@ -3,6 +3,7 @@
 
 #include "base/common.h"
 #include "math/aabb.h"
+#include "math/integrate.h"
 #include "math/shape.h"
 #include "math/vector.h"
 
@@ -13,7 +14,19 @@ typedef enum {
     StaticBody
 } bodyTypeT;
 
+// The forces acting on a body. Bodies are integrated in groups by force model,
+// so the built-in models are much cheaper than a derivatives function.
+typedef enum {
+    BallisticModel, // No forces. The body moves in a straight line.
+    DragModel,      // Drag slows the body down. See bodySetDrag().
+    ThrustModel,    // Drag, plus thrust and turning. See bodySetThrust().
+    CustomModel,    // Forces from a derivatives function.
+    NumForceModels
+} forceModelT;
 
+// Bodies keep a reference to their shape, so the caller can release its own
+// reference after creating the body. Bodies made with bodyNewSquare() share
+// one interned shape per size.
 bodyT* bodyNew      (shapeT* shape, float mass);
 bodyT* bodyNewSquare(float width, float height, float mass);
 void   bodyFree     (bodyT* body);
@@ -27,17 +40,50 @@ void  bodySetOrientation(      bodyT* body, float angle);
 float bodyMass   (const bodyT* body            );
 void  bodySetMass(      bodyT* body, float mass);
 
+// Moving or turning a body by hand wakes it, like the velocity and force
+// setters do.
 vec2 bodyPosition   (const bodyT* body          );
 void bodySetPosition(      bodyT* body, vec2 pos);
 
+// The position and orientation of the body at the start of the last world
+// step. Blend these with the current ones to draw the body in between steps.
+vec2  bodyPrevPosition   (const bodyT* body);
+float bodyPrevOrientation(const bodyT* body);
+
 bodyTypeT bodyType   (const bodyT* body          );
 void      bodySetType(      bodyT* body, int type);
 
+bool bodyIsSleeping(const bodyT* body);
+
+// Continuous collision detection keeps small, fast bodies (like bullets) from
+// passing through other bodies between steps, at some extra cost. Off by
+// default.
+bool bodyIsCCD (const bodyT* body          );
+void bodySetCCD(      bodyT* body, bool ccd);
+
 vec2 bodyVelocity   (const bodyT* body          );
 void bodySetVelocity(      bodyT* body, vec2 vel);
 
-void bodySetDerivativeFn(bodyT* body, void(*deriv_fn)(void));
+forceModelT bodyForceModel   (const bodyT* body                   );
+void        bodySetForceModel(      bodyT* body, forceModelT model);
+
+// The drag coefficients are how much acceleration (or angular acceleration)
+// the body gets per unit of velocity, against its motion. Used by DragModel
+// and ThrustModel.
+void bodySetDrag(bodyT* body, float linear, float angular);
+
+// Sets the acceleration along the body x axis and the angular acceleration
+// applied to a body with ThrustModel.
+void bodySetThrust(bodyT* body, float thrust, float turn);
+
+// Switches the body to CustomModel, with the specified function giving the
+// derivatives of its state. This is the slow path. NULL switches the body
+// back to BallisticModel.
+void bodySetDerivativeFn(bodyT* body, derivativeFnT deriv_fn);
 
+// Forces, impulses and torques wake the body up. Forces and torques add up
+// until the next world step, which applies them over the whole step and then
+// clears them.
 void bodyApplyForce  (bodyT* body, vec2 f, vec2 p);
 void bodyApplyImpulse(bodyT* body, vec2 i, vec2 p);
 void bodyApplyTorque (bodyT* body, float t);
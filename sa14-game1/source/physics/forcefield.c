@@ -0,0 +1,187 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "forcefield.h"
+
+#include "physics_p.h"
+
+#include "base/array.h"
+#include "base/common.h"
+#include "base/debug.h"
+#include "math/vector.h"
+#include "physics/quadtree.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// Keeps the pull of fields and bodies from blowing up at short distances. It
+// acts as if the mass were spread out over about this distance.
+#define FieldSoftening (0.1f)
+
+// The Barnes-Hut opening angle. Groups of bodies that look smaller than this
+// (size over distance) are treated as a single body. Smaller is more exact.
+#define GravityTheta (0.5f)
+
+// Sleeping bodies are woken up by fields stronger than this. Anything weaker
+// couldn't keep the body moving fast enough to stay awake anyway.
+#define FieldWakeAcceleration (0.02f)
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+struct forceFieldT {
+    vec2  pos;
+    float strength;
+    float radius; // Zero for no limit.
+};
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+forceFieldT* worldAddForceField(worldT* world, vec2 pos, float strength,
+                                float radius)
+{
+    forceFieldT* field = malloc(sizeof(forceFieldT));
+
+    field->pos      = pos;
+    field->strength = strength;
+    field->radius   = radius;
+
+    arrayAdd(world->fields, &field);
+
+    return (field);
+}
+
+void worldRemoveForceField(worldT* world, forceFieldT* field) {
+    for (int i = 0; i < arrayLength(world->fields); i++) {
+        if (*(forceFieldT**)arrayGet(world->fields, i) == field) {
+            arrayRemove(world->fields, i);
+            free(field);
+            return;
+        }
+    }
+
+    assert(false);
+}
+
+void freeForceFields(worldT* world) {
+    for (int i = 0; i < arrayLength(world->fields); i++)
+        free(*(forceFieldT**)arrayGet(world->fields, i));
+
+    arrayFree(world->fields);
+    world->fields = NULL;
+
+    quadTreeFree(world->gravity_tree);
+    world->gravity_tree = NULL;
+
+    free(world->gravity_mass);
+    world->gravity_mass = NULL;
+}
+
+vec2 forceFieldPosition(const forceFieldT* field) {
+    return (field->pos);
+}
+
+void forceFieldSetPosition(forceFieldT* field, vec2 pos) {
+    field->pos = pos;
+}
+
+void forceFieldSetStrength(forceFieldT* field, float strength) {
+    field->strength = strength;
+}
+
+void forceFieldSetRadius(forceFieldT* field, float radius) {
+    field->radius = radius;
+}
+
+void worldSetMutualGravity(worldT* world, float g) {
+    world->gravity = g;
+}
+
+bool prepareForceFields(worldT* world) {
+    if (world->gravity == 0.0f)
+        return (arrayLength(world->fields) > 0);
+
+    // The tree is built from the masses of the dynamic bodies. Static bodies
+    // have no mass in the world arrays, so they neither pull nor get pulled.
+    int n = world->num_bodies;
+
+    size_t size = max(n, 1) * sizeof(float);
+
+    world->gravity_mass = realloc(world->gravity_mass, size);
+    for (int i = 0; i < n; i++) {
+        float inv_mass = world->inv_mass[i];
+        world->gravity_mass[i] = (inv_mass > 0.0f) ? 1.0f/inv_mass : 0.0f;
+    }
+
+    if (!world->gravity_tree)
+        world->gravity_tree = quadTreeNew();
+
+    quadTreeBuild(world->gravity_tree, world->state.x, world->state.y,
+                  world->gravity_mass, n);
+
+    return (true);
+}
+
+void applyForceFields(worldT* world, int begin, int end) {
+    int           num_fields = arrayLength(world->fields);
+    forceFieldT** fields     = NULL;
+
+    if (num_fields > 0)
+        fields = arrayGet(world->fields, 0);
+
+    float eps2 = FieldSoftening*FieldSoftening;
+
+    for (int i = begin; i < end; i++) {
+        if (world->inv_mass[i] == 0.0f)
+            continue;
+
+        vec2 p = { .x = world->state.x[i], .y = world->state.y[i] };
+        vec2 a = { .x = 0.0f, .y = 0.0f };
+
+        for (int j = 0; j < num_fields; j++) {
+            const forceFieldT* field = fields[j];
+
+            float dx = field->pos.x - p.x;
+            float dy = field->pos.y - p.y;
+            float d2 = dx*dx + dy*dy;
+
+            if (field->radius > 0.0f && d2 > field->radius*field->radius)
+                continue;
+
+            float r2 = d2 + eps2;
+            float f  = field->strength / (r2*sqrtf(r2));
+
+            a.x += dx*f;
+            a.y += dy*f;
+        }
+
+        if (world->gravity != 0.0f) {
+            vec2 g = quadTreeAcceleration(world->gravity_tree, p, i,
+                                          GravityTheta, FieldSoftening);
+
+            a.x += g.x*world->gravity;
+            a.y += g.y*world->gravity;
+        }
+
+        if (!world->awake[i]) {
+            float a2 = a.x*a.x + a.y*a.y;
+            if (a2 <= FieldWakeAcceleration*FieldWakeAcceleration)
+                continue;
+
+            worldWakeBody(world, i);
+        }
+
+        // The fields add to the same accelerations as bodyApplyForce(), which
+        // are used up in the step.
+        world->ax[i] += a.x;
+        world->ay[i] += a.y;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef forcefield_h_
+#define forcefield_h_
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/common.h"
+#include "math/vector.h"
+#include "physics/physics.h"
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+// A point in the world that pulls bodies towards it, or pushes them away.
+// Fields act on every dynamic body in the world, like gravity, so they don't
+// care about the body mass.
+typedef struct forceFieldT forceFieldT;
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+// Adds a field that gives bodies an acceleration of strength/r^2 towards pos,
+// where r is the distance to it. Negative strengths push bodies away. Bodies
+// further away than the radius are not affected, unless the radius is zero.
+// The world owns the field.
+forceFieldT* worldAddForceField(worldT* world, vec2 pos, float strength,
+                                float radius);
+
+// Removes the field from the world and frees it.
+void worldRemoveForceField(worldT* world, forceFieldT* field);
+
+vec2 forceFieldPosition   (const forceFieldT* field          );
+void forceFieldSetPosition(      forceFieldT* field, vec2 pos);
+
+void forceFieldSetStrength(forceFieldT* field, float strength);
+void forceFieldSetRadius  (forceFieldT* field, float radius  );
+
+// Makes every dynamic body pull every other one towards it with an
+// acceleration of g*m/r^2, where m is the mass of the pulling body. Zero (the
+// default) turns mutual gravity off. This is approximated with a Barnes-Hut
+// quadtree, so it's O(n log n) rather than O(n^2).
+void worldSetMutualGravity(worldT* world, float g);
+
+#endif // forcefield_h_
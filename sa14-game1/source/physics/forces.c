@@ -0,0 +1,172 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "physics_p.h"
+
+#include "base/common.h"
+#include "math/integrate.h"
+#include "math/trig.h"
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// Specifies the integration function to use for bodies with custom
+// derivatives functions. The built-in force models use fourth-order
+// Runge-Kutta, written out for each model.
+#define IntegrateFn rk4Integrate
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static inline void dragFactors(float k, float dt, float* v_scale,
+                               float* x_scale)
+{
+    // Runge-Kutta applied to v' = -k*v, x' = v works out to a polynomial in
+    // k*dt, so we can skip the four stages and get the exact same result.
+    float h = k*dt;
+
+    *x_scale = dt*(1.0f - h*(0.5f - h*(1.0f/6.0f - h*(1.0f/24.0f))));
+    *v_scale = 1.0f - k*(*x_scale);
+}
+
+static void integrateDrag(worldT* world, const int* bodies, int n,
+                          float dt)
+{
+    const bodyStatesT*  prev   = &world->prev_state;
+    bodyStatesT*        state  = &world->state;
+    const forceParamsT* params = world->force_params;
+
+    for (int i = 0; i < n; i++) {
+        int body = bodies[i];
+
+        float v_scale, x_scale, w_scale, o_scale;
+        dragFactors(params[body].drag        , dt, &v_scale, &x_scale);
+        dragFactors(params[body].angular_drag, dt, &w_scale, &o_scale);
+
+        state->x [body] = prev->x [body] + prev->vx[body]*x_scale;
+        state->y [body] = prev->y [body] + prev->vy[body]*x_scale;
+        state->o [body] = prev->o [body] + prev->w [body]*o_scale;
+        state->vx[body] = prev->vx[body]*v_scale;
+        state->vy[body] = prev->vy[body]*v_scale;
+        state->w [body] = prev->w [body]*w_scale;
+    }
+}
+
+static inline void thrustDerivatives(const float* s, const forceParamsT* p,
+                                     float* derivs)
+{
+    float sin_o, cos_o;
+    trig_sincos(s[2], &sin_o, &cos_o);
+
+    derivs[0] = s[3];
+    derivs[1] = s[4];
+    derivs[2] = s[5];
+    derivs[3] = p->thrust*cos_o - p->drag*s[3];
+    derivs[4] = p->thrust*sin_o - p->drag*s[4];
+    derivs[5] = p->turn - p->angular_drag*s[5];
+}
+
+static inline void integrateThrustBody(float* s, const forceParamsT* p,
+                                       float dt)
+{
+    // The thrust follows the orientation, so there's no shortcut like for
+    // drag. This is rk4Integrate() with the derivatives inlined.
+    float tmp[6], k1[6], k2[6], k3[6], k4[6];
+
+    thrustDerivatives(s, p, k1);
+    for (int i = 0; i < 6; i++) tmp[i] = s[i]+k1[i]*dt*0.5f;
+    thrustDerivatives(tmp, p, k2);
+    for (int i = 0; i < 6; i++) tmp[i] = s[i]+k2[i]*dt*0.5f;
+    thrustDerivatives(tmp, p, k3);
+    for (int i = 0; i < 6; i++) tmp[i] = s[i]+k3[i]*dt;
+    thrustDerivatives(tmp, p, k4);
+
+    for (int i = 0; i < 6; i++)
+        s[i] += (1.0f/6.0f)*(k1[i]+2.0f*(k2[i]+k3[i])+k4[i])*dt;
+}
+
+static void integrateThrust(worldT* world, const int* bodies, int n,
+                            float dt)
+{
+    for (int i = 0; i < n; i++) {
+        int   body = bodies[i];
+        float s[6];
+
+        loadBodyState(&world->prev_state, body, s);
+        integrateThrustBody(s, &world->force_params[body], dt);
+        storeBodyState(&world->state, body, s);
+    }
+}
+
+static void integrateCustom(worldT* world, const int* bodies, int n,
+                            float dt)
+{
+    // The slow path: one indirect call per stage per body.
+    for (int i = 0; i < n; i++) {
+        int   body = bodies[i];
+        float s[6], derivs[6];
+
+        loadBodyState(&world->prev_state, body, s);
+        IntegrateFn(s, derivs, 6, dt, world->deriv_fns[body]);
+        storeBodyState(&world->state, body, s);
+    }
+}
+
+void integrateForces(worldT* world, forceModelT model, const int* bodies,
+                     int n, float dt)
+{
+    switch (model) {
+    case DragModel:   integrateDrag  (world, bodies, n, dt); break;
+    case ThrustModel: integrateThrust(world, bodies, n, dt); break;
+    case CustomModel: integrateCustom(world, bodies, n, dt); break;
+    default:          assert(false);                         break;
+    }
+}
+
+void integrateBodyForces(const worldT* world, int body, float* s, float dt) {
+    const forceParamsT* p = &world->force_params[body];
+
+    switch (world->force_models[body]) {
+
+    case BallisticModel: {
+        s[0] += s[3]*dt;
+        s[1] += s[4]*dt;
+        s[2] += s[5]*dt;
+        break;
+    }
+
+    case DragModel: {
+        float v_scale, x_scale, w_scale, o_scale;
+        dragFactors(p->drag        , dt, &v_scale, &x_scale);
+        dragFactors(p->angular_drag, dt, &w_scale, &o_scale);
+
+        s[0] += s[3]*x_scale;
+        s[1] += s[4]*x_scale;
+        s[2] += s[5]*o_scale;
+        s[3] *= v_scale;
+        s[4] *= v_scale;
+        s[5] *= w_scale;
+        break;
+    }
+
+    case ThrustModel: {
+        integrateThrustBody(s, p, dt);
+        break;
+    }
+
+    case CustomModel: {
+        float derivs[6];
+        IntegrateFn(s, derivs, 6, dt, world->deriv_fns[body]);
+        break;
+    }
+
+    default: {
+        assert(false);
+        break;
+    }
+
+    }
+}
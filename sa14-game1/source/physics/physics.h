@@ -3,9 +3,24 @@
 
 #define Kilogram 1.0f
 
+// Thread safety: a world must only be used by one thread at a time, with two
+// exceptions. The read-only calls (the body getters and the world queries)
+// may be made from many threads at once while nothing modifies the world,
+// and the following body calls only touch the slots of their own body, so
+// different threads may make them on different bodies of the same world:
+//
+//   bodySetVelocity(), bodySetThrust(), bodySetDrag(), bodyApplyForce(),
+//   bodyApplyImpulse(), bodyApplyTorque()
+//
+// Everything else must be serialized with all other use of the world. In
+// particular bodySetPosition() and bodySetOrientation() move the body in the
+// broadphase, which is shared by all bodies, and bodyNew() and bodyFree()
+// use a pool shared by all worlds.
+
 typedef struct worldT worldT;
 
 #include "physics/body.h"
+#include "physics/forcefield.h"
 #include "physics/world.h"
 
 #endif // physics_h_
@@ -7,15 +7,39 @@
 
 #include "base/array.h"
 #include "base/common.h"
+#include "base/jobs.h"
+#include "math/aabb.h"
+#include "math/integrate.h"
 #include "math/shape.h"
 #include "math/vector.h"
+#include "physics/aabbtree.h"
 #include "physics/body.h"
 #include "physics/physics.h"
+#include "physics/quadtree.h"
+#include "physics/spatialhash.h"
+#include "physics/sweepandprune.h"
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// The max number of ranges that parallel loops in worldStep() are split into.
+// Ranges that produce results write them to their own arrays.
+#define MaxJobRanges 64
 
 /*------------------------------------------------
  * TYPES
  *----------------------------------------------*/
 
+// Parameters of the built-in force models. See bodySetDrag() and
+// bodySetThrust().
+typedef struct {
+    float drag;         // Linear and angular drag coefficients.
+    float angular_drag;
+    float thrust;       // Acceleration along the body x axis.
+    float turn;         // Angular acceleration.
+} forceParamsT;
+
 typedef struct {
     vec2  x; // Position.
     float o; // Orientation.
@@ -25,29 +49,215 @@ typedef struct {
     float t; // Torque.
 } bodyStateT;
 
+// The bodyT struct only holds cold data (data that isn't touched every step).
+// Once a body has been added to a world, its state lives in the world body
+// arrays and the body is just a handle to its slot there.
 struct bodyT {
-    worldT* world;
+    worldT* world; // The world the body has been added to, or NULL.
+    int     id;    // The slot of the body in the world body arrays.
 
     shapeT* shape;
 
+    // Only used until the body is added to a world.
     bodyStateT state;
-    bodyStateT prev_state;
 
     bodyTypeT type;
     float     inv_mass;
     float     inv_inertia;
     float     restitution;
+    bool      ccd;
 
-    void (*deriv_fn)(void);
-
-    bodyT* prev;
-    bodyT* next;
+    forceModelT   force_model;
+    forceParamsT  force_params;
+    derivativeFnT deriv_fn;
 };
 
+// Body states, stored as a structure of arrays so that loops over all bodies
+// run through contiguous memory.
+typedef struct {
+    float* x;  // Position.
+    float* y;
+    float* o;  // Orientation.
+    float* vx; // Velocity.
+    float* vy;
+    float* w;  // Angular velocity.
+} bodyStatesT;
+
+typedef struct {
+    int a; // Body ids.
+    int b;
+} bodyPairT;
+
+// A single contact point, kept between steps so that the solver can start
+// from the impulse it ended up with last step (warm starting).
+typedef struct {
+    int   a;      // Body ids.
+    int   b;      // -1 for contacts with the world bounds.
+    int   id;     // The contact point id from the collision.
+    vec2  normal; // Contact normal, pointing towards body a.
+    vec2  ra;     // The contact point relative to the body centers.
+    vec2  rb;
+    float depth;  // Penetration depth.
+    float share;  // The share of the position correction for the collision.
+    float mass_n; // Effective mass along the normal and the tangent.
+    float mass_t;
+    float bias;   // Target normal velocity, for restitution.
+    float pn;     // Accumulated normal impulse.
+    float pt;     // Accumulated friction impulse.
+} contactT;
+
 struct worldT {
-    bodyT* bodies;
+    int num_bodies;
+    int max_bodies;
+
+    bodyStatesT state;
+    bodyStatesT prev_state;
+
+    // Body positions and orientations at the start of the last step. Unlike
+    // prev_state, these are not moved by continuous collision detection, so
+    // they can be used to draw bodies in between steps.
+    float* start_x;
+    float* start_y;
+    float* start_o;
+
+    float* ax; // Accumulated acceleration.
+    float* ay;
+    float* t;  // Accumulated torque.
+
+    float* inv_mass;
+    float* inv_inertia;
+    float* restitution;
+
+    // Shape AABB center and half extents in body space. Used to find the
+    // world space AABBs without going through the shapes.
+    float* cx;
+    float* cy;
+    float* hx;
+    float* hy;
+
+    // Sleeping bodies (and static bodies, which never wake up) are not moved,
+    // and are only tested for collisions against awake bodies.
+    bool*  awake;
+    float* sleep_time; // How long the body has been moving slowly enough.
+
+    // Scratch arrays used to find islands of touching bodies.
+    int*  island;       // Union-find parent.
+    bool* island_awake; // Whether any body in the island is still moving.
+
+    // The fraction of the current step at which prev_state applies. Bodies
+    // that have been stopped at their time of impact have a non-zero alpha.
+    float* alpha;
+
+    // Bodies with continuous collision detection are swept through the step
+    // and stopped at their time of impact. The others are only tested for
+    // collisions where they end up at the end of the step.
+    bool* ccd;
+
+    aabbT* aabbs; // World space AABBs. Swept over the whole step for bodies
+                  // with continuous collision detection.
 
+    forceModelT*   force_models;
+    forceParamsT*  force_params;
+    derivativeFnT* deriv_fns; // Only used by bodies with CustomModel.
+    bodyT**        bodies;
+
+    // Awake bodies with forces acting on them, grouped by force model so that
+    // each group can be integrated in one loop. Model m has the bodies from
+    // force_offsets[m] up to force_offsets[m+1]. Filled in every step.
+    int* force_bodies;
+    int  force_offsets[NumForceModels+1];
+
+    // Broad-phase collision detection.
+    broadphaseT     broadphase;
+    spatialHashT*   spatial_hash;
+    sweepAndPruneT* sap;
+
+    arrayT* pairs;      // Broad-phase pairs (of bodyPairT).
+    arrayT* impacts;    // Pairs that might collide during the step.
+
+    aabbT       bounds;
+    boundsModeT bounds_mode;
+
+    arrayT*    fields;       // Force fields (of forceFieldT*).
+    float      gravity;      // Mutual gravity constant, zero for none.
+    quadTreeT* gravity_tree; // Barnes-Hut tree over the body masses.
+    float*     gravity_mass; // Body masses, zero for static bodies.
+
+    // Spatial index for the query functions in query.c. Kept up to date at the
+    // end of every step, and when bodies are moved by hand.
+    aabbTreeT* tree;
+    int*       proxies; // The tree proxy of each body.
+
+    jobSystemT* jobs; // NULL to run everything on the calling thread.
+
+    // Per-range results from the parallel parts of the step, merged in range
+    // order so that we get the same results as on a single thread.
+    arrayT* range_pairs     [MaxJobRanges];
+    arrayT* range_collisions[MaxJobRanges];
     arrayT* collisions; // Used to hold collisions during collision testing.
+
+    // Contacts from this step and the last one, used by the contact solver.
+    arrayT* contacts;
+    arrayT* prev_contacts;
 };
 
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+// Gets the force fields ready for applyForceFields(). Returns false if there
+// are no fields in the world.
+bool prepareForceFields(worldT* world);
+
+// Adds the accelerations from the force fields to bodies [begin, end). Safe to
+// run on several ranges at the same time.
+void applyForceFields(worldT* world, int begin, int end);
+
+void freeForceFields(worldT* world);
+
+// Transforms the shape points and edge normals into world space, with the
+// shape at the specified position and orientation.
+void transformShape(const shapeT* shape, float x, float y, float o,
+                    vec2* points, vec2* normals);
+
+// Returns the world space AABB of a body in the specified state.
+aabbT findBodyAABB(const worldT* world, const bodyStatesT* state, int body);
+
+// Updates the tree proxy of a body after it has been moved.
+void worldMoveProxy(worldT* world, int body);
+
+// Wakes up the body and clears its sleep timer. Does nothing for static bodies.
+void worldWakeBody(worldT* world, int body);
+
+// Integrates the bodies in the list from their previous state, dt seconds
+// forward, with the forces of the specified model (which can't be
+// BallisticModel; those are done in a batch).
+void integrateForces(worldT* world, forceModelT model, const int* bodies,
+                     int n, float dt);
+
+// Integrates a single body state in the format below, dt seconds forward,
+// with the forces of the body's force model.
+void integrateBodyForces(const worldT* world, int body, float* state,
+                         float dt);
+
+// Reads body i into the state vector format expected by the integrators and
+// derivative functions: { x.x, x.y, o, v.x, v.y, w }.
+static inline void loadBodyState(const bodyStatesT* s, int i, float* state) {
+    state[0] = s->x [i];
+    state[1] = s->y [i];
+    state[2] = s->o [i];
+    state[3] = s->vx[i];
+    state[4] = s->vy[i];
+    state[5] = s->w [i];
+}
+
+static inline void storeBodyState(bodyStatesT* s, int i, const float* state) {
+    s->x [i] = state[0];
+    s->y [i] = state[1];
+    s->o [i] = state[2];
+    s->vx[i] = state[3];
+    s->vy[i] = state[4];
+    s->w [i] = state[5];
+}
+
 #endif // physics_p_h_
@@ -0,0 +1,284 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "quadtree.h"
+
+#include "base/common.h"
+#include "base/debug.h"
+#include "math/vector.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// Points that are still in the same node at this depth (because they are on
+// top of each other) share a leaf instead of splitting it further.
+#define MaxDepth 24
+
+// Enough for a depth-first walk down to MaxDepth, with three nodes waiting at
+// every level.
+#define MaxStackSize (3*MaxDepth + 4)
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct {
+    float x, y; // The min corner of the node square.
+    float size; // The side length of the node square.
+
+    float mass;   // Total mass of the points in the node.
+    float cx, cy; // Center of mass. Mass-weighted sums until the tree is done.
+
+    int child[4]; // Node indices of the quadrants, -1 where there are none.
+    int point;    // The first point in a leaf, -1 for inner nodes.
+} quadNodeT;
+
+struct quadTreeT {
+    quadNodeT* nodes;
+    int        num_nodes;
+    int        max_nodes;
+
+    const float* x;
+    const float* y;
+    const float* mass;
+};
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static int addNode(quadTreeT* tree, float x, float y, float size) {
+    if (tree->num_nodes >= tree->max_nodes) {
+        tree->max_nodes = max(64, 2*tree->max_nodes);
+        tree->nodes     = realloc(tree->nodes,
+                                  tree->max_nodes * sizeof(quadNodeT));
+    }
+
+    quadNodeT* node = &tree->nodes[tree->num_nodes];
+
+    node->x        = x;
+    node->y        = y;
+    node->size     = size;
+    node->mass     = 0.0f;
+    node->cx       = 0.0f;
+    node->cy       = 0.0f;
+    node->child[0] = node->child[1] = node->child[2] = node->child[3] = -1;
+    node->point    = -1;
+
+    return (tree->num_nodes++);
+}
+
+static int quadrant(const quadNodeT* node, float x, float y) {
+    float half = 0.5f*node->size;
+
+    return ((x >= node->x+half ? 1 : 0) | (y >= node->y+half ? 2 : 0));
+}
+
+static int addChild(quadTreeT* tree, int node, int q) {
+    // Note that addNode() may move the nodes, so we can't hold on to pointers
+    // across the call.
+    quadNodeT* n    = &tree->nodes[node];
+    float      half = 0.5f*n->size;
+    float      x    = n->x + ((q & 1) ? half : 0.0f);
+    float      y    = n->y + ((q & 2) ? half : 0.0f);
+
+    int child = addNode(tree, x, y, half);
+    tree->nodes[node].child[q] = child;
+
+    return (child);
+}
+
+static bool nodeContains(const quadNodeT* node, vec2 p) {
+    return (p.x >= node->x && p.x < node->x+node->size
+         && p.y >= node->y && p.y < node->y+node->size);
+}
+
+static void addMass(quadNodeT* node, float x, float y, float m) {
+    node->mass += m;
+    node->cx   += m*x;
+    node->cy   += m*y;
+}
+
+static void insertPoint(quadTreeT* tree, int i) {
+    float x = tree->x[i], y = tree->y[i], m = tree->mass[i];
+    int   node = 0;
+
+    for (int depth = 0; ; depth++) {
+        quadNodeT* n = &tree->nodes[node];
+
+        bool empty = (n->mass == 0.0f && n->point < 0);
+
+        addMass(n, x, y, m);
+
+        if (empty) {
+            n->point = i;
+            return;
+        }
+
+        if (n->point >= 0) {
+            // A leaf. Push the point that's already here one level down, so
+            // the leaf becomes an inner node, unless we're as deep as we go.
+            if (depth == MaxDepth)
+                return;
+
+            int   j  = n->point;
+            float xj = tree->x[j], yj = tree->y[j];
+
+            n->point = -1;
+
+            int child = addChild(tree, node, quadrant(n, xj, yj));
+
+            addMass(&tree->nodes[child], xj, yj, tree->mass[j]);
+            tree->nodes[child].point = j;
+        }
+
+        n = &tree->nodes[node];
+
+        int q     = quadrant(n, x, y);
+        int child = n->child[q];
+
+        if (child < 0) {
+            child = addChild(tree, node, q);
+
+            addMass(&tree->nodes[child], x, y, m);
+            tree->nodes[child].point = i;
+            return;
+        }
+
+        node = child;
+    }
+}
+
+quadTreeT* quadTreeNew(void) {
+    quadTreeT* tree = calloc(1, sizeof(quadTreeT));
+
+    return (tree);
+}
+
+void quadTreeFree(quadTreeT* tree) {
+    if (!tree)
+        return;
+
+    free(tree->nodes);
+    free(tree);
+}
+
+void quadTreeBuild(quadTreeT* tree, const float* x, const float* y,
+                   const float* mass, int n)
+{
+    tree->x         = x;
+    tree->y         = y;
+    tree->mass      = mass;
+    tree->num_nodes = 0;
+
+    // The root is the smallest square around all points. It's grown a bit so
+    // that points on the max edges still fall inside.
+    float min_x =  FLT_MAX, min_y =  FLT_MAX;
+    float max_x = -FLT_MAX, max_y = -FLT_MAX;
+
+    for (int i = 0; i < n; i++) {
+        if (mass[i] <= 0.0f)
+            continue;
+
+        min_x = min(min_x, x[i]); max_x = max(max_x, x[i]);
+        min_y = min(min_y, y[i]); max_y = max(max_y, y[i]);
+    }
+
+    if (min_x > max_x)
+        return;
+
+    float size = max(max_x-min_x, max_y-min_y);
+    size = size*1.001f + 0.001f;
+
+    addNode(tree, min_x, min_y, size);
+
+    for (int i = 0; i < n; i++) {
+        if (mass[i] > 0.0f)
+            insertPoint(tree, i);
+    }
+
+    for (int i = 0; i < tree->num_nodes; i++) {
+        quadNodeT* node = &tree->nodes[i];
+
+        node->cx /= node->mass;
+        node->cy /= node->mass;
+    }
+}
+
+vec2 quadTreeAcceleration(const quadTreeT* tree, vec2 p, int self,
+                          float theta, float softening)
+{
+    vec2 a = { .x = 0.0f, .y = 0.0f };
+
+    if (tree->num_nodes == 0)
+        return (a);
+
+    float theta2 = theta*theta;
+    float eps2   = softening*softening;
+
+    int stack[MaxStackSize];
+    int num_stack = 0;
+
+    stack[num_stack++] = 0;
+
+    while (num_stack > 0) {
+        const quadNodeT* node = &tree->nodes[stack[--num_stack]];
+
+        float m  = node->mass;
+        float cx = node->cx;
+        float cy = node->cy;
+
+        if (node->point >= 0) {
+            // A leaf, usually with a single point in it. Every point inside
+            // the leaf square is in the leaf, so if p is in there, we take
+            // self out of the sum.
+            if (self >= 0 && nodeContains(node, p)) {
+                float ms = tree->mass[self];
+
+                if (m - ms <= 0.0f)
+                    continue;
+
+                cx = (cx*m - tree->x[self]*ms) / (m - ms);
+                cy = (cy*m - tree->y[self]*ms) / (m - ms);
+                m -= ms;
+            }
+        }
+        else {
+            // Inner nodes that are far enough away (and don't hold p) are
+            // treated as a single point. Otherwise we look at the quadrants.
+            float dx = cx - p.x;
+            float dy = cy - p.y;
+
+            float s2 = node->size*node->size;
+
+            if (nodeContains(node, p) || s2 >= theta2*(dx*dx + dy*dy)) {
+                for (int q = 0; q < 4; q++) {
+                    if (node->child[q] >= 0)
+                        stack[num_stack++] = node->child[q];
+                }
+
+                continue;
+            }
+        }
+
+        float dx = cx - p.x;
+        float dy = cy - p.y;
+        float r2 = dx*dx + dy*dy + eps2;
+
+        if (r2 <= 0.0f)
+            continue;
+
+        float f = m / (r2*sqrtf(r2));
+
+        a.x += dx*f;
+        a.y += dy*f;
+    }
+
+    return (a);
+}
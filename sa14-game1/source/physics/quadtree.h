@@ -0,0 +1,43 @@
+#ifndef quadtree_h_
+#define quadtree_h_
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/common.h"
+#include "math/vector.h"
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+// A Barnes-Hut quadtree over point masses. Every node knows the total mass and
+// center of mass of the points below it, so the pull of a group of points
+// that is far enough away can be found from the node alone. That makes the
+// acceleration of every point from every other point O(n log n) instead of
+// O(n^2).
+typedef struct quadTreeT quadTreeT;
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+quadTreeT* quadTreeNew(void);
+void quadTreeFree(quadTreeT* tree);
+
+// Rebuilds the tree from n points. Points with zero mass are left out. The
+// arrays must stay untouched until the tree is rebuilt or freed, since the
+// tree refers to them.
+void quadTreeBuild(quadTreeT* tree, const float* x, const float* y,
+                   const float* mass, int n);
+
+// Returns the sum of mass/r^2 towards every point in the tree (other than the
+// point with index self, if it's in the tree), as seen from p. Groups whose
+// size over distance is below theta are treated as a single point, so zero
+// gives the exact sum. The softening length keeps the pull from blowing up
+// when two points get close.
+vec2 quadTreeAcceleration(const quadTreeT* tree, vec2 p, int self,
+                          float theta, float softening);
+
+#endif // quadtree_h_
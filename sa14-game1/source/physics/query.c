@@ -0,0 +1,235 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "physics_p.h"
+#include "world.h"
+
+#include "base/array.h"
+#include "base/common.h"
+#include "math/aabb.h"
+#include "math/shape.h"
+#include "math/vector.h"
+#include "physics/aabbtree.h"
+
+#include <float.h>
+#include <math.h>
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct {
+    const worldT* world;
+    arrayT*       bodies;
+    aabbT         aabb;
+    vec2          center; // Only used by radius queries.
+    float         radius;
+} regionQueryT;
+
+typedef struct {
+    const worldT* world;
+    vec2          origin;
+    vec2          dir;    // Normalized.
+    rayHitT*      hit;
+    bool          found;
+} rayQueryT;
+
+typedef struct {
+    const worldT* world;
+    vec2          p;
+    const bodyT*  ignore;
+} nearestQueryT;
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static void worldShape(const worldT* world, int body, vec2* points,
+                       vec2* normals)
+{
+    const bodyStatesT* s = &world->state;
+    transformShape(world->bodies[body]->shape, s->x[body], s->y[body],
+                   s->o[body], points, normals);
+}
+
+static float shapeDistance(const worldT* world, int body, vec2 p) {
+    // Finds the distance from p to the convex body shape, which is zero if p
+    // is inside it.
+    vec2 points [ShapeMaxPoints];
+    vec2 normals[ShapeMaxPoints];
+
+    worldShape(world, body, points, normals);
+
+    int n = world->bodies[body]->shape->num_points;
+
+    float separation = -FLT_MAX;
+    for (int i = 0; i < n; i++) {
+        float d = normals[i].x*(p.x - points[i].x)
+                + normals[i].y*(p.y - points[i].y);
+
+        separation = max(separation, d);
+    }
+
+    if (separation <= 0.0f)
+        return (0.0f);
+
+    float min_d2 = FLT_MAX;
+    for (int i = 0; i < n; i++) {
+        vec2 a = points[i];
+        vec2 b = points[(i+1) % n];
+
+        float ex = b.x - a.x, ey = b.y - a.y;
+        float px = p.x - a.x, py = p.y - a.y;
+
+        float e2 = ex*ex + ey*ey;
+        float t  = (e2 > 0.0f) ? (px*ex + py*ey) / e2 : 0.0f;
+
+        t = max(0.0f, min(t, 1.0f));
+
+        float dx = px - t*ex;
+        float dy = py - t*ey;
+
+        min_d2 = min(min_d2, dx*dx + dy*dy);
+    }
+
+    return (sqrtf(min_d2));
+}
+
+static bool addAABBBody(void* data, int id) {
+    regionQueryT* query = data;
+
+    // The tree AABBs are enlarged, so we test the actual ones.
+    aabbT aabb = findBodyAABB(query->world, &query->world->state, id);
+    if (aabbOverlap(&aabb, &query->aabb))
+        arrayAdd(query->bodies, &query->world->bodies[id]);
+
+    return (true);
+}
+
+void worldQueryAABB(const worldT* world, aabbT aabb, arrayT* bodies) {
+    regionQueryT query = { world, bodies, aabb };
+    aabbTreeQuery(world->tree, &aabb, addAABBBody, &query);
+}
+
+static bool addRadiusBody(void* data, int id) {
+    regionQueryT* query = data;
+
+    if (shapeDistance(query->world, id, query->center) <= query->radius)
+        arrayAdd(query->bodies, &query->world->bodies[id]);
+
+    return (true);
+}
+
+void worldQueryRadius(const worldT* world, vec2 center, float radius,
+                      arrayT* bodies)
+{
+    regionQueryT query = {
+        world, bodies,
+        { { .x = center.x - radius, .y = center.y - radius },
+          { .x = center.x + radius, .y = center.y + radius } },
+        center, radius
+    };
+
+    aabbTreeQuery(world->tree, &query.aabb, addRadiusBody, &query);
+}
+
+static float rayHitBody(void* data, int id, float max_t) {
+    // Clips the ray against the edge lines of the convex shape. The ray is
+    // inside the shape between the last line it crosses on the way in and the
+    // first one it crosses on the way out.
+    rayQueryT*    query = data;
+    const worldT* world = query->world;
+
+    vec2 points [ShapeMaxPoints];
+    vec2 normals[ShapeMaxPoints];
+
+    worldShape(world, id, points, normals);
+
+    vec2  p       = query->origin;
+    vec2  d       = query->dir;
+    float t_enter = 0.0f;
+    float t_exit  = max_t;
+    int   edge    = -1;
+
+    for (int i = 0; i < world->bodies[id]->shape->num_points; i++) {
+        const vec2* n = &normals[i];
+
+        float num = n->x*(points[i].x - p.x) + n->y*(points[i].y - p.y);
+        float den = n->x*d.x + n->y*d.y;
+
+        if (den == 0.0f) {
+            if (num < 0.0f)
+                return (max_t);
+
+            continue;
+        }
+
+        float t = num / den;
+
+        if (den < 0.0f) {
+            if (t > t_enter) {
+                t_enter = t;
+                edge    = i;
+            }
+        }
+        else {
+            t_exit = min(t_exit, t);
+        }
+
+        if (t_enter > t_exit)
+            return (max_t);
+    }
+
+    // Without an edge, the ray started inside the shape.
+    if (edge < 0)
+        return (max_t);
+
+    rayHitT* hit = query->hit;
+
+    hit->body     = world->bodies[id];
+    hit->point    = (vec2) { .x = p.x + d.x*t_enter, .y = p.y + d.y*t_enter };
+    hit->normal   = normals[edge];
+    hit->distance = t_enter;
+
+    query->found = true;
+
+    return (t_enter);
+}
+
+bool worldRaycast(const worldT* world, vec2 origin, vec2 dir, float max_dist,
+                  rayHitT* hit)
+{
+    float len = sqrtf(dir.x*dir.x + dir.y*dir.y);
+    if (len == 0.0f)
+        return (false);
+
+    rayQueryT query = {
+        world, origin, { .x = dir.x/len, .y = dir.y/len }, hit, false
+    };
+
+    aabbTreeRaycast(world->tree, origin, query.dir, max_dist, rayHitBody,
+                    &query);
+
+    return (query.found);
+}
+
+static float bodyDistance(void* data, int id, float max_dist) {
+    nearestQueryT* query = data;
+
+    if (query->world->bodies[id] == query->ignore)
+        return (FLT_MAX);
+
+    return (shapeDistance(query->world, id, query->p));
+}
+
+bodyT* worldNearest(const worldT* world, vec2 p, float max_dist,
+                    const bodyT* ignore)
+{
+    nearestQueryT query = { world, p, ignore };
+
+    int id = aabbTreeNearest(world->tree, p, max_dist, bodyDistance, &query,
+                             NULL);
+
+    return ((id >= 0) ? world->bodies[id] : NULL);
+}
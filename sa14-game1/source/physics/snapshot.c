@@ -0,0 +1,189 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "world.h"
+
+#include "physics_p.h"
+
+#include "base/array.h"
+#include "base/common.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// Marks the start of a snapshot, so that we don't restore garbage. Bump the
+// last digit when the layout changes.
+#define SnapshotMagic (0x50485931u)
+
+// The number of per-body float arrays in a snapshot. See floatArrays().
+#define NumFloatArrays 10
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+// The header is followed by NumFloatArrays arrays of num_bodies floats, the
+// awake flags (one byte each, padded to a multiple of four bytes) and finally
+// num_contacts contacts.
+typedef struct {
+    uint32_t magic;
+    int32_t  num_bodies;
+    int32_t  num_contacts;
+} snapshotHeaderT;
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static void floatArrays(const worldT* world, float** arrays) {
+    arrays[0] = world->state.x;
+    arrays[1] = world->state.y;
+    arrays[2] = world->state.o;
+    arrays[3] = world->state.vx;
+    arrays[4] = world->state.vy;
+    arrays[5] = world->state.w;
+    arrays[6] = world->ax;
+    arrays[7] = world->ay;
+    arrays[8] = world->t;
+    arrays[9] = world->sleep_time;
+}
+
+static size_t awakeSize(int num_bodies) {
+    return ((num_bodies + 3) & ~3);
+}
+
+static size_t snapshotSize(int num_bodies, int num_contacts) {
+    return (sizeof(snapshotHeaderT)
+          + NumFloatArrays * num_bodies * sizeof(float)
+          + awakeSize(num_bodies)
+          + num_contacts * sizeof(contactT));
+}
+
+uint32_t worldStateHash(const worldT* world) {
+    // FNV-1a over the bytes of the body states. Meant for checking that two
+    // runs are in lockstep, not for security.
+    float* arrays[NumFloatArrays];
+    floatArrays(world, arrays);
+
+    uint32_t h = 2166136261u;
+    int      n = world->num_bodies;
+
+    for (int i = 0; i < NumFloatArrays; i++) {
+        const uint8_t* p = (const uint8_t*)arrays[i];
+
+        for (size_t j = 0; j < n*sizeof(float); j++)
+            h = (h ^ p[j]) * 16777619u;
+    }
+
+    for (int i = 0; i < n; i++)
+        h = (h ^ (world->awake[i] ? 1u : 0u)) * 16777619u;
+
+    return (h);
+}
+
+size_t worldSnapshotSize(const worldT* world) {
+    return (snapshotSize(world->num_bodies, arrayLength(world->contacts)));
+}
+
+size_t worldSnapshot(const worldT* world, void* buf, size_t buf_size) {
+    int    n            = world->num_bodies;
+    int    num_contacts = arrayLength(world->contacts);
+    size_t size         = snapshotSize(n, num_contacts);
+
+    if (buf_size < size)
+        return (0);
+
+    uint8_t* p = buf;
+
+    snapshotHeaderT header = { SnapshotMagic, n, num_contacts };
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+
+    float* arrays[NumFloatArrays];
+    floatArrays(world, arrays);
+
+    for (int i = 0; i < NumFloatArrays; i++) {
+        memcpy(p, arrays[i], n * sizeof(float));
+        p += n * sizeof(float);
+    }
+
+    // The awake flags are stored as bytes, whatever the size of a bool.
+    for (int i = 0; i < n; i++)
+        p[i] = world->awake[i];
+
+    memset(p+n, 0, awakeSize(n)-n);
+    p += awakeSize(n);
+
+    if (num_contacts > 0)
+        memcpy(p, arrayGet(world->contacts, 0), num_contacts*sizeof(contactT));
+
+    return (size);
+}
+
+bool worldRestore(worldT* world, const void* buf, size_t size) {
+    const uint8_t* p = buf;
+
+    snapshotHeaderT header;
+    if (size < sizeof(header))
+        return (false);
+
+    memcpy(&header, p, sizeof(header));
+    p += sizeof(header);
+
+    int n = header.num_bodies;
+
+    // We can only go back to a snapshot taken with the same bodies in it.
+    // Bodies that were removed and added again since may have other ids, so
+    // a matching count is as far as we can check.
+    if (header.magic != SnapshotMagic || n != world->num_bodies)
+        return (false);
+
+    if (header.num_contacts < 0
+     || size != snapshotSize(n, header.num_contacts))
+    {
+        return (false);
+    }
+
+    float* arrays[NumFloatArrays];
+    floatArrays(world, arrays);
+
+    for (int i = 0; i < NumFloatArrays; i++) {
+        memcpy(arrays[i], p, n * sizeof(float));
+        p += n * sizeof(float);
+    }
+
+    for (int i = 0; i < n; i++)
+        world->awake[i] = (p[i] != 0);
+
+    p += awakeSize(n);
+
+    arrayClear(world->contacts);
+    for (int i = 0; i < header.num_contacts; i++) {
+        arrayAdd(world->contacts, p);
+        p += sizeof(contactT);
+    }
+
+    // The previous state is overwritten at the start of the next step, so we
+    // only need it to match for anything looking at it before then.
+    memcpy(world->prev_state.x , world->state.x , n * sizeof(float));
+    memcpy(world->prev_state.y , world->state.y , n * sizeof(float));
+    memcpy(world->prev_state.o , world->state.o , n * sizeof(float));
+    memcpy(world->prev_state.vx, world->state.vx, n * sizeof(float));
+    memcpy(world->prev_state.vy, world->state.vy, n * sizeof(float));
+    memcpy(world->prev_state.w , world->state.w , n * sizeof(float));
+    memset(world->alpha, 0, n * sizeof(float));
+
+    memcpy(world->start_x, world->state.x, n * sizeof(float));
+    memcpy(world->start_y, world->state.y, n * sizeof(float));
+    memcpy(world->start_o, world->state.o, n * sizeof(float));
+
+    for (int i = 0; i < n; i++)
+        worldMoveProxy(world, i);
+
+    return (true);
+}
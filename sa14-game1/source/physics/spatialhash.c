@@ -0,0 +1,335 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "spatialhash.h"
+
+#include "physics_p.h"
+
+#include "base/array.h"
+#include "base/common.h"
+#include "math/aabb.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// The cell size is picked automatically from the average body size every time
+// the hash is rebuilt, but we never let it go below this value.
+#define MinCellSize (0.01f)
+
+// The cell size relative to the average body AABB extent. Two seems to give a
+// good balance between the number of cells per body and bodies per cell.
+#define CellSizeFactor (2.0f)
+
+// Minimum number of hash buckets.
+#define MinBuckets (64)
+
+// Proxies that would cover more cells than this (a big static body among
+// small ones, or a long swept AABB) are kept out of the cells and tested
+// against every other proxy instead. With the cell size above, an average
+// body covers at most four cells.
+#define MaxCellsPerProxy (16)
+
+// Cell coordinates are clamped to this range, so that bodies far outside the
+// world don't overflow the conversion to int.
+#define MaxCellCoord (1 << 20)
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct {
+    int   body; // Body id.
+    aabbT aabb;
+    bool  large; // Not in any cell, see MaxCellsPerProxy.
+} proxyT;
+
+typedef struct {
+    int cx, cy; // Cell coordinates.
+    int proxy;  // Index of the proxy in the cell.
+} cellEntryT;
+
+struct spatialHashT {
+    proxyT* proxies;
+    int     num_proxies;
+    int     max_proxies;
+
+    cellEntryT* entries; // Entries in insertion order.
+    cellEntryT* sorted;  // Entries sorted by bucket.
+    int         num_entries;
+    int         max_entries;
+
+    int* buckets; // Offsets into the sorted entry array, num_buckets+1 of them.
+    int  num_buckets;
+    int  max_buckets;
+
+    int* large; // Indices of the proxies that are too large for the cells.
+    int  num_large;
+    int  max_large;
+
+    float cell_size;
+    float extent_sum;
+};
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static void* growBuffer(void* buf, int* max_elems, int num_elems,
+                        size_t elem_size)
+{
+    if (num_elems <= *max_elems)
+        return (buf);
+
+    int n = max(*max_elems, 16);
+    while (n < num_elems)
+        n *= 2;
+
+    *max_elems = n;
+    return (realloc(buf, n * elem_size));
+}
+
+static inline int cellCoord(float x, float cell_size) {
+    float c = floorf(x / cell_size);
+
+    c = max(-(float)MaxCellCoord, min(c, (float)MaxCellCoord));
+
+    return ((int)c);
+}
+
+static inline unsigned int hashCell(int cx, int cy, int num_buckets) {
+    // Large primes from Teschner et al., "Optimized Spatial Hashing for
+    // Collision Detection of Deformable Objects".
+    unsigned int h = ((unsigned int)cx * 73856093u)
+                   ^ ((unsigned int)cy * 19349663u);
+
+    return (h & (num_buckets-1));
+}
+
+spatialHashT* spatialHashNew(void) {
+    spatialHashT* hash = calloc(1, sizeof(spatialHashT));
+
+    hash->cell_size = 1.0f;
+
+    return (hash);
+}
+
+void spatialHashFree(spatialHashT* hash) {
+    if (!hash)
+        return;
+
+    free(hash->proxies);
+    free(hash->entries);
+    free(hash->sorted);
+    free(hash->buckets);
+    free(hash->large);
+    free(hash);
+}
+
+void spatialHashClear(spatialHashT* hash) {
+    hash->num_proxies = 0;
+    hash->num_entries = 0;
+    hash->extent_sum  = 0.0f;
+}
+
+void spatialHashInsert(spatialHashT* hash, int body, const aabbT* aabb) {
+    hash->proxies = growBuffer(hash->proxies, &hash->max_proxies,
+                               hash->num_proxies+1, sizeof(proxyT));
+
+    proxyT* proxy = &hash->proxies[hash->num_proxies++];
+
+    proxy->body  = body;
+    proxy->aabb  = *aabb;
+    proxy->large = false;
+
+    hash->extent_sum += max(aabb->max.x - aabb->min.x,
+                            aabb->max.y - aabb->min.y);
+}
+
+void spatialHashBuild(spatialHashT* hash) {
+    // Pick a cell size based on the average body size so that most bodies
+    // only touch a handful of cells.
+    float avg_extent = hash->extent_sum / max(hash->num_proxies, 1);
+    float cell_size  = max(avg_extent * CellSizeFactor, MinCellSize);
+
+    hash->cell_size   = cell_size;
+    hash->num_entries = 0;
+    hash->num_large   = 0;
+
+    for (int i = 0; i < hash->num_proxies; i++) {
+        proxyT*      proxy = &hash->proxies[i];
+        const aabbT* aabb  = &proxy->aabb;
+
+        int x0 = cellCoord(aabb->min.x, cell_size);
+        int y0 = cellCoord(aabb->min.y, cell_size);
+        int x1 = cellCoord(aabb->max.x, cell_size);
+        int y1 = cellCoord(aabb->max.y, cell_size);
+
+        int nx = x1-x0+1;
+        int ny = y1-y0+1;
+
+        // Checking each side first keeps the product from overflowing.
+        if (nx > MaxCellsPerProxy || ny > MaxCellsPerProxy
+         || nx*ny > MaxCellsPerProxy)
+        {
+            hash->large = growBuffer(hash->large, &hash->max_large,
+                                     hash->num_large+1, sizeof(int));
+
+            hash->large[hash->num_large++] = i;
+            proxy->large = true;
+
+            continue;
+        }
+
+        proxy->large = false;
+
+        int n = hash->num_entries + nx*ny;
+        hash->entries = growBuffer(hash->entries, &hash->max_entries, n,
+                                   sizeof(cellEntryT));
+
+        for (int cy = y0; cy <= y1; cy++) {
+            for (int cx = x0; cx <= x1; cx++) {
+                cellEntryT* e = &hash->entries[hash->num_entries++];
+
+                e->cx    = cx;
+                e->cy    = cy;
+                e->proxy = i;
+            }
+        }
+    }
+
+    // Allocate the sorted array with the same capacity as the entry array.
+    hash->sorted = realloc(hash->sorted,
+                           hash->max_entries * sizeof(cellEntryT));
+
+    // Now we counting sort the entries by bucket. The bucket count is always a
+    // power of two so we can mask instead of doing modulo.
+    int num_buckets = MinBuckets;
+    while (num_buckets < 2*hash->num_entries)
+        num_buckets <<= 1;
+
+    hash->num_buckets = num_buckets;
+    hash->buckets     = growBuffer(hash->buckets, &hash->max_buckets,
+                                   num_buckets+1, sizeof(int));
+
+    int* buckets = hash->buckets;
+    memset(buckets, 0, (num_buckets+1) * sizeof(int));
+
+    for (int i = 0; i < hash->num_entries; i++) {
+        cellEntryT* e = &hash->entries[i];
+        buckets[hashCell(e->cx, e->cy, num_buckets)+1]++;
+    }
+
+    for (int i = 0; i < num_buckets; i++)
+        buckets[i+1] += buckets[i];
+
+    // We use the bucket offsets as insertion cursors here, which leaves each
+    // offset pointing at the start of the next bucket when we're done...
+    for (int i = 0; i < hash->num_entries; i++) {
+        cellEntryT*  e = &hash->entries[i];
+        unsigned int b = hashCell(e->cx, e->cy, num_buckets);
+
+        hash->sorted[buckets[b]++] = *e;
+    }
+
+    // ...so we shift them back one step.
+    for (int i = num_buckets; i > 0; i--)
+        buckets[i] = buckets[i-1];
+    buckets[0] = 0;
+}
+
+int spatialHashNumBuckets(const spatialHashT* hash) {
+    return (hash->num_buckets);
+}
+
+void spatialHashFindPairs(spatialHashT* hash, arrayT* pairs) {
+    spatialHashBuild(hash);
+    spatialHashFindPairsInBuckets(hash, 0, hash->num_buckets, pairs);
+}
+
+static void addPair(arrayT* pairs, const proxyT* p1, const proxyT* p2) {
+    // Keep the pair order stable so that results don't depend on hash bucket
+    // order.
+    bodyPairT pair;
+    if (p1->body < p2->body) {
+        pair.a = p1->body;
+        pair.b = p2->body;
+    }
+    else {
+        pair.a = p2->body;
+        pair.b = p1->body;
+    }
+
+    arrayAdd(pairs, &pair);
+}
+
+static void findLargePairs(const spatialHashT* hash, arrayT* pairs) {
+    for (int i = 0; i < hash->num_large; i++) {
+        int           k  = hash->large[i];
+        const proxyT* p1 = &hash->proxies[k];
+
+        for (int j = 0; j < hash->num_proxies; j++) {
+            const proxyT* p2 = &hash->proxies[j];
+
+            // A pair of large proxies is reported by the first one.
+            if (p2->large && j <= k)
+                continue;
+
+            if (aabbOverlap(&p1->aabb, &p2->aabb))
+                addPair(pairs, p1, p2);
+        }
+    }
+}
+
+void spatialHashFindPairsInBuckets(const spatialHashT* hash, int begin, int end,
+                                   arrayT* pairs)
+{
+    float cell_size = hash->cell_size;
+
+    for (int b = begin; b < end; b++) {
+        int first = hash->buckets[b];
+        int last  = hash->buckets[b+1];
+
+        for (int i = first; i < last; i++) {
+            cellEntryT* e1 = &hash->sorted[i];
+
+            for (int j = i+1; j < last; j++) {
+                cellEntryT* e2 = &hash->sorted[j];
+
+                // Different cells can end up in the same bucket.
+                if (e1->cx != e2->cx || e1->cy != e2->cy)
+                    continue;
+
+                proxyT* p1 = &hash->proxies[e1->proxy];
+                proxyT* p2 = &hash->proxies[e2->proxy];
+
+                if (!aabbOverlap(&p1->aabb, &p2->aabb))
+                    continue;
+
+                // Two bodies can share more than one cell. To report each pair
+                // once, we only report it from the cell containing the min
+                // corner of the AABB intersection.
+                float min_x = max(p1->aabb.min.x, p2->aabb.min.x);
+                float min_y = max(p1->aabb.min.y, p2->aabb.min.y);
+
+                if (cellCoord(min_x, cell_size) != e1->cx
+                 || cellCoord(min_y, cell_size) != e1->cy)
+                {
+                    continue;
+                }
+
+                addPair(pairs, p1, p2);
+            }
+        }
+    }
+
+    // The large proxies go with the last range, so that the ranges still
+    // add up to the same pairs in the same order.
+    if (end == hash->num_buckets)
+        findLargePairs(hash, pairs);
+}
@@ -0,0 +1,44 @@
+#ifndef spatialhash_h_
+#define spatialhash_h_
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/array.h"
+#include "base/common.h"
+#include "math/aabb.h"
+#include "physics/physics.h"
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct spatialHashT spatialHashT;
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+spatialHashT* spatialHashNew(void);
+void spatialHashFree(spatialHashT* hash);
+
+void spatialHashClear(spatialHashT* hash);
+void spatialHashInsert(spatialHashT* hash, int body, const aabbT* aabb);
+
+// Finds all pairs of inserted bodies with overlapping AABBs and adds them to
+// the specified array (of bodyPairT). Each pair is reported exactly once.
+// Bodies much larger than the average are tested against all the others
+// rather than spread out over lots of cells.
+void spatialHashFindPairs(spatialHashT* hash, arrayT* pairs);
+
+// The same as above, split in two so the pair search can be run in parallel.
+// Build the cells once, then search any number of disjoint bucket ranges at
+// the same time. Pairs from consecutive ranges, concatenated in order, come
+// out the same as from spatialHashFindPairs().
+void spatialHashBuild(spatialHashT* hash);
+int spatialHashNumBuckets(const spatialHashT* hash);
+void spatialHashFindPairsInBuckets(const spatialHashT* hash, int begin, int end,
+                                   arrayT* pairs);
+
+#endif // spatialhash_h_
@@ -0,0 +1,662 @@
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "sweepandprune.h"
+
+#include "physics_p.h"
+
+#include "base/array.h"
+#include "base/common.h"
+#include "math/aabb.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// Keys used to mark free and removed slots in the pair set.
+#define EmptyKey   (~(uint64_t)0)
+#define RemovedKey (~(uint64_t)1)
+
+// The initial pair set capacity. Must be a power of two.
+#define InitialPairCapacity (64)
+
+// Marks the endpoints of removed proxies until they are dropped.
+#define RemovedEndpoint (-1)
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct {
+    aabbT aabb;
+
+    // The indices of the proxy's endpoints along the x and y-axes. Not valid
+    // until the proxy has been merged in (see sapFindPairs()).
+    int min[2];
+    int max[2];
+
+    int first_pair; // The first pair in the proxy's list, or -1.
+    int added;      // Index in the list of added proxies, or -1.
+} proxyT;
+
+typedef struct {
+    float value; // Position along the axis.
+    int   data;  // Proxy id shifted left one bit. Lowest bit set for max.
+} endpointT;
+
+// Each pair is in the lists of both its proxies, so the pairs of a proxy can
+// be found without looking through all of them.
+typedef struct {
+    int proxies[2];
+    int next[2]; // The next pair in the list of proxies[i], or -1.
+    int prev[2];
+} pairT;
+
+typedef struct {
+    uint64_t key;
+    int      pair; // Index into the pair array.
+} pairSlotT;
+
+struct sweepAndPruneT {
+    proxyT* proxies;
+    int     num_proxies;
+    int     max_proxies;
+
+    // The endpoints along both axes are kept sorted between updates. Since
+    // bodies don't move very far in a single step, the arrays are almost
+    // sorted every time we get here, which makes insertion sort run in
+    // near-linear time.
+    endpointT* endpoints[2];
+    int        max_endpoints[2];
+    int        num_endpoints;
+    bool       has_removed; // Some endpoints belong to removed proxies.
+
+    // Proxies added since the last update. Their endpoints are sorted on
+    // their own and merged in with the rest in one pass, rather than moved
+    // into place one swap at a time.
+    int*       added;
+    int        num_added;
+    int        max_added;
+    endpointT* added_endpoints;
+    int        max_added_endpoints;
+
+    // The pairs of proxies that overlap along both axes, in no particular
+    // order. A pair is only added or removed when endpoints swap places
+    // during sorting, or when proxies are added or removed.
+    pairT* pairs;
+    int    num_pairs;
+    int    max_pairs;
+
+    // Open-addressing hash set for looking up pairs by their proxies.
+    pairSlotT* slots;
+    int        num_removed;
+    int        max_slots;
+
+    // Scratch space for finding the pairs of added proxies.
+    int* active;
+    int  max_active;
+};
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+static void* growBuffer(void* buf, int* max_elems, int num_elems,
+                        size_t elem_size)
+{
+    if (num_elems <= *max_elems)
+        return (buf);
+
+    int n = max(*max_elems, 16);
+    while (n < num_elems)
+        n *= 2;
+
+    *max_elems = n;
+    return (realloc(buf, n * elem_size));
+}
+
+static inline float axisValue(const vec2* v, int axis) {
+    return ((axis == 0) ? v->x : v->y);
+}
+
+static inline uint64_t pairKey(int a, int b) {
+    if (a > b) {
+        int tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    return (((uint64_t)a << 32) | (uint32_t)b);
+}
+
+static inline int hashPair(uint64_t key, int max_slots) {
+    // Fibonacci hashing.
+    return ((int)((key * 11400714819323198485ull) >> 32) & (max_slots-1));
+}
+
+static void resizePairSet(sweepAndPruneT* sap, int max_slots) {
+    pairSlotT* old_slots = sap->slots;
+    int        old_max   = sap->max_slots;
+
+    sap->slots       = malloc(max_slots * sizeof(pairSlotT));
+    sap->max_slots   = max_slots;
+    sap->num_removed = 0;
+
+    for (int i = 0; i < max_slots; i++)
+        sap->slots[i].key = EmptyKey;
+
+    for (int i = 0; i < old_max; i++) {
+        uint64_t key = old_slots[i].key;
+        if (key == EmptyKey || key == RemovedKey)
+            continue;
+
+        int slot = hashPair(key, max_slots);
+        while (sap->slots[slot].key != EmptyKey)
+            slot = (slot+1) & (max_slots-1);
+
+        sap->slots[slot] = old_slots[i];
+    }
+
+    free(old_slots);
+}
+
+static int findSlot(const sweepAndPruneT* sap, uint64_t key) {
+    int mask = sap->max_slots-1;
+    int slot = hashPair(key, sap->max_slots);
+
+    while (sap->slots[slot].key != EmptyKey) {
+        if (sap->slots[slot].key == key)
+            return (slot);
+
+        slot = (slot+1) & mask;
+    }
+
+    return (-1);
+}
+
+// Adds a key that isn't in the set yet.
+static void insertKey(sweepAndPruneT* sap, uint64_t key, int pair) {
+    // Keep the load factor below one half, counting removed slots since they
+    // make probing longer, too.
+    if ((sap->num_pairs+sap->num_removed+1)*2 > sap->max_slots) {
+        int max_slots = sap->max_slots;
+        if ((sap->num_pairs+1)*4 > max_slots)
+            max_slots *= 2;
+
+        resizePairSet(sap, max_slots);
+    }
+
+    int mask = sap->max_slots-1;
+    int slot = hashPair(key, sap->max_slots);
+
+    while (sap->slots[slot].key != EmptyKey
+        && sap->slots[slot].key != RemovedKey)
+    {
+        slot = (slot+1) & mask;
+    }
+
+    if (sap->slots[slot].key == RemovedKey)
+        sap->num_removed--;
+
+    sap->slots[slot].key  = key;
+    sap->slots[slot].pair = pair;
+}
+
+static void removeSlot(sweepAndPruneT* sap, int slot) {
+    sap->slots[slot].key = RemovedKey;
+    sap->num_removed++;
+}
+
+static inline int pairSide(const pairT* pair, int proxy) {
+    return ((pair->proxies[0] == proxy) ? 0 : 1);
+}
+
+// Points the neighbors of the pair at index p in both its lists (or the heads
+// of the lists) at it.
+static void linkPair(sweepAndPruneT* sap, int p) {
+    const pairT* pair = &sap->pairs[p];
+
+    for (int i = 0; i < 2; i++) {
+        int proxy = pair->proxies[i];
+        int prev  = pair->prev[i];
+        int next  = pair->next[i];
+
+        if (prev >= 0)
+            sap->pairs[prev].next[pairSide(&sap->pairs[prev], proxy)] = p;
+        else
+            sap->proxies[proxy].first_pair = p;
+
+        if (next >= 0)
+            sap->pairs[next].prev[pairSide(&sap->pairs[next], proxy)] = p;
+    }
+}
+
+static void unlinkPair(sweepAndPruneT* sap, int p) {
+    const pairT* pair = &sap->pairs[p];
+
+    for (int i = 0; i < 2; i++) {
+        int proxy = pair->proxies[i];
+        int prev  = pair->prev[i];
+        int next  = pair->next[i];
+
+        if (prev >= 0)
+            sap->pairs[prev].next[pairSide(&sap->pairs[prev], proxy)] = next;
+        else
+            sap->proxies[proxy].first_pair = next;
+
+        if (next >= 0)
+            sap->pairs[next].prev[pairSide(&sap->pairs[next], proxy)] = prev;
+    }
+}
+
+static void addPair(sweepAndPruneT* sap, int a, int b) {
+    if (a == b)
+        return;
+
+    uint64_t key = pairKey(a, b);
+    if (findSlot(sap, key) >= 0)
+        return;
+
+    sap->pairs = growBuffer(sap->pairs, &sap->max_pairs, sap->num_pairs+1,
+                            sizeof(pairT));
+
+    int    p    = sap->num_pairs;
+    pairT* pair = &sap->pairs[p];
+
+    pair->proxies[0] = a;
+    pair->proxies[1] = b;
+
+    // New pairs go first in both lists.
+    for (int i = 0; i < 2; i++) {
+        pair->prev[i] = -1;
+        pair->next[i] = sap->proxies[pair->proxies[i]].first_pair;
+    }
+
+    linkPair(sap, p);
+    insertKey(sap, key, p);
+
+    sap->num_pairs++;
+}
+
+static void removePair(sweepAndPruneT* sap, int a, int b) {
+    int slot = findSlot(sap, pairKey(a, b));
+    if (slot < 0)
+        return;
+
+    int p = sap->slots[slot].pair;
+
+    removeSlot(sap, slot);
+    unlinkPair(sap, p);
+
+    // The last pair fills the hole, so the live pairs stay packed.
+    int last = --sap->num_pairs;
+    if (p == last)
+        return;
+
+    pairT* pair = &sap->pairs[p];
+
+    *pair = sap->pairs[last];
+    linkPair(sap, p);
+
+    slot = findSlot(sap, pairKey(pair->proxies[0], pair->proxies[1]));
+    sap->slots[slot].pair = p;
+}
+
+// Returns whether the intervals of the two proxies overlap along the axis,
+// going by the order of their endpoints.
+static inline bool overlapsAlong(const sweepAndPruneT* sap, int a, int b,
+                                 int axis)
+{
+    const proxyT* pa = &sap->proxies[a];
+    const proxyT* pb = &sap->proxies[b];
+
+    return (pa->min[axis] < pb->max[axis] && pb->min[axis] < pa->max[axis]);
+}
+
+static inline void placeEndpoint(sweepAndPruneT* sap, int axis, int index,
+                                 endpointT e)
+{
+    proxyT* proxy = &sap->proxies[e.data>>1];
+
+    if (e.data & 1)
+        proxy->max[axis] = index;
+    else
+        proxy->min[axis] = index;
+
+    sap->endpoints[axis][index] = e;
+}
+
+sweepAndPruneT* sapNew(void) {
+    sweepAndPruneT* sap = calloc(1, sizeof(sweepAndPruneT));
+
+    resizePairSet(sap, InitialPairCapacity);
+
+    return (sap);
+}
+
+void sapFree(sweepAndPruneT* sap) {
+    if (!sap)
+        return;
+
+    free(sap->proxies);
+    free(sap->endpoints[0]);
+    free(sap->endpoints[1]);
+    free(sap->added);
+    free(sap->added_endpoints);
+    free(sap->pairs);
+    free(sap->slots);
+    free(sap->active);
+    free(sap);
+}
+
+void sapAddProxy(sweepAndPruneT* sap, int id) {
+    assert(id == sap->num_proxies);
+
+    sap->proxies = growBuffer(sap->proxies, &sap->max_proxies, id+1,
+                              sizeof(proxyT));
+    sap->added   = growBuffer(sap->added, &sap->max_added, sap->num_added+1,
+                              sizeof(int));
+
+    // The proxy gets its endpoints with the next update, once its AABB is
+    // known.
+    proxyT* proxy = &sap->proxies[id];
+
+    proxy->min[0]     = proxy->min[1] = -1;
+    proxy->max[0]     = proxy->max[1] = -1;
+    proxy->first_pair = -1;
+    proxy->added      = sap->num_added;
+
+    sap->added[sap->num_added++] = id;
+    sap->num_proxies++;
+}
+
+void sapRemoveProxy(sweepAndPruneT* sap, int id) {
+    assert(0 <= id && id < sap->num_proxies);
+
+    proxyT* proxy = &sap->proxies[id];
+
+    while (proxy->first_pair >= 0) {
+        const pairT* pair = &sap->pairs[proxy->first_pair];
+        removePair(sap, pair->proxies[0], pair->proxies[1]);
+    }
+
+    if (proxy->added >= 0) {
+        int moved = sap->added[--sap->num_added];
+
+        sap->added[proxy->added]  = moved;
+        sap->proxies[moved].added = proxy->added;
+    }
+    else {
+        // The endpoints are dropped the next time they are sorted, rather
+        // than moving all the ones after them now.
+        for (int i = 0; i < 2; i++) {
+            sap->endpoints[i][proxy->min[i]].data = RemovedEndpoint;
+            sap->endpoints[i][proxy->max[i]].data = RemovedEndpoint;
+        }
+
+        sap->has_removed = true;
+    }
+
+    int last = --sap->num_proxies;
+    if (id == last)
+        return;
+
+    // The last proxy takes over the id, so its pairs and endpoints are
+    // renamed.
+    proxyT* moved = &sap->proxies[last];
+
+    for (int p = moved->first_pair; p >= 0; ) {
+        pairT* pair = &sap->pairs[p];
+        int    side = pairSide(pair, last);
+
+        removeSlot(sap, findSlot(sap, pairKey(last, pair->proxies[1-side])));
+        pair->proxies[side] = id;
+        insertKey(sap, pairKey(id, pair->proxies[1-side]), p);
+
+        p = pair->next[side];
+    }
+
+    if (moved->added >= 0) {
+        sap->added[moved->added] = id;
+    }
+    else {
+        for (int i = 0; i < 2; i++) {
+            sap->endpoints[i][moved->min[i]].data = (id<<1);
+            sap->endpoints[i][moved->max[i]].data = (id<<1) | 1;
+        }
+    }
+
+    *proxy = *moved;
+}
+
+void sapUpdateProxy(sweepAndPruneT* sap, int body, const aabbT* aabb) {
+    assert(0 <= body && body < sap->num_proxies);
+
+    sap->proxies[body].aabb = *aabb;
+}
+
+// Drops the endpoints of removed proxies, and loads the new positions of the
+// rest. Returns the number of endpoints left.
+static int loadEndpoints(sweepAndPruneT* sap, int axis) {
+    endpointT* endpoints = sap->endpoints[axis];
+    int        n         = 0;
+
+    for (int i = 0; i < sap->num_endpoints; i++) {
+        endpointT e = endpoints[i];
+
+        if (e.data == RemovedEndpoint)
+            continue;
+
+        const aabbT* aabb = &sap->proxies[e.data>>1].aabb;
+
+        e.value = axisValue((e.data & 1) ? &aabb->max : &aabb->min, axis);
+
+        if (sap->has_removed)
+            placeEndpoint(sap, axis, n, e);
+        else
+            endpoints[n] = e;
+
+        n++;
+    }
+
+    return (n);
+}
+
+static void sortEndpoints(sweepAndPruneT* sap, int axis) {
+    endpointT* endpoints = sap->endpoints[axis];
+    int        other     = 1 - axis;
+
+    for (int i = 1; i < sap->num_endpoints; i++) {
+        endpointT e = endpoints[i];
+        int       j = i-1;
+
+        while (j >= 0 && endpoints[j].value > e.value) {
+            endpointT o = endpoints[j];
+
+            // Endpoint e is moving left past o. If a min moves past a max, the
+            // two intervals start overlapping along this axis, and the pair is
+            // added if they overlap along the other one, too. If a max moves
+            // past a min, they stop overlapping. Other swaps don't change
+            // anything. The other axis goes by the order of the endpoints
+            // rather than their values, so that ties are settled the same way
+            // when that axis is sorted.
+            bool e_is_max = (e.data & 1);
+            bool o_is_max = (o.data & 1);
+            int  a        = e.data>>1;
+            int  b        = o.data>>1;
+
+            if (!e_is_max && o_is_max) {
+                if (overlapsAlong(sap, a, b, other))
+                    addPair(sap, a, b);
+            }
+            else if (e_is_max && !o_is_max) {
+                removePair(sap, a, b);
+            }
+
+            placeEndpoint(sap, axis, j+1, o);
+            j--;
+        }
+
+        if (j+1 != i)
+            placeEndpoint(sap, axis, j+1, e);
+    }
+}
+
+static int compareEndpoints(const void* p1, const void* p2) {
+    const endpointT* a = p1;
+    const endpointT* b = p2;
+
+    if (a->value != b->value)
+        return ((a->value < b->value) ? -1 : 1);
+
+    // Ties are broken by proxy so the order doesn't depend on qsort(). The
+    // min of a proxy comes before its max.
+    return (a->data - b->data);
+}
+
+static void mergeAddedEndpoints(sweepAndPruneT* sap, int axis) {
+    int num_added = 2*sap->num_added;
+
+    sap->added_endpoints = growBuffer(sap->added_endpoints,
+                                      &sap->max_added_endpoints, num_added,
+                                      sizeof(endpointT));
+
+    endpointT* added = sap->added_endpoints;
+
+    for (int i = 0; i < sap->num_added; i++) {
+        int          id   = sap->added[i];
+        const aabbT* aabb = &sap->proxies[id].aabb;
+
+        added[2*i  ] = (endpointT) { axisValue(&aabb->min, axis), (id<<1)     };
+        added[2*i+1] = (endpointT) { axisValue(&aabb->max, axis), (id<<1) | 1 };
+    }
+
+    qsort(added, num_added, sizeof(endpointT), compareEndpoints);
+
+    int n = sap->num_endpoints;
+
+    sap->endpoints[axis] = growBuffer(sap->endpoints[axis],
+                                      &sap->max_endpoints[axis], n+num_added,
+                                      sizeof(endpointT));
+
+    // Merging from the back moves every endpoint at most once, and stops as
+    // soon as the rest are where they belong.
+    const endpointT* endpoints = sap->endpoints[axis];
+
+    int i = n-1;
+    int j = num_added-1;
+    int k = n+num_added;
+
+    while (j >= 0) {
+        if (i >= 0 && endpoints[i].value > added[j].value)
+            placeEndpoint(sap, axis, --k, endpoints[i--]);
+        else
+            placeEndpoint(sap, axis, --k, added[j--]);
+    }
+}
+
+static inline void addActive(int* list, int* pos, int* num, int id) {
+    pos[id]        = *num;
+    list[(*num)++] = id;
+}
+
+static inline void removeActive(int* list, int* pos, int* num, int id) {
+    int last = list[--(*num)];
+
+    list[pos[id]] = last;
+    pos[last]     = pos[id];
+}
+
+// Sweeps along the x-axis once to find the pairs of the added proxies.
+static void findAddedPairs(sweepAndPruneT* sap) {
+    int n = sap->num_proxies;
+
+    sap->active = growBuffer(sap->active, &sap->max_active, 4*n,
+                             sizeof(int));
+
+    // The proxies whose intervals the sweep is inside of, and the added ones
+    // among them.
+    int* active     = sap->active;
+    int* active_pos = sap->active + n;
+    int* added      = sap->active + 2*n;
+    int* added_pos  = sap->active + 3*n;
+    int  num_active = 0;
+    int  num_added  = 0;
+
+    const endpointT* endpoints = sap->endpoints[0];
+
+    for (int i = 0; i < sap->num_endpoints; i++) {
+        int  id       = endpoints[i].data>>1;
+        bool is_added = (sap->proxies[id].added >= 0);
+
+        if (endpoints[i].data & 1) {
+            removeActive(active, active_pos, &num_active, id);
+
+            if (is_added)
+                removeActive(added, added_pos, &num_added, id);
+
+            continue;
+        }
+
+        // Each pair is found when the second of its intervals starts. Pairs
+        // of proxies that were both there before are known already.
+        const int* others     = is_added ? active     : added;
+        int        num_others = is_added ? num_active : num_added;
+
+        for (int j = 0; j < num_others; j++) {
+            if (overlapsAlong(sap, id, others[j], 1))
+                addPair(sap, id, others[j]);
+        }
+
+        addActive(active, active_pos, &num_active, id);
+
+        if (is_added)
+            addActive(added, added_pos, &num_added, id);
+    }
+}
+
+static void insertAddedProxies(sweepAndPruneT* sap) {
+    for (int i = 0; i < 2; i++)
+        mergeAddedEndpoints(sap, i);
+
+    sap->num_endpoints += 2*sap->num_added;
+
+    findAddedPairs(sap);
+
+    for (int i = 0; i < sap->num_added; i++)
+        sap->proxies[sap->added[i]].added = -1;
+
+    sap->num_added = 0;
+}
+
+void sapFindPairs(sweepAndPruneT* sap, arrayT* pairs) {
+    int num_endpoints = 0;
+
+    for (int i = 0; i < 2; i++)
+        num_endpoints = loadEndpoints(sap, i);
+
+    sap->num_endpoints = num_endpoints;
+    sap->has_removed   = false;
+
+    // The proxies that were there before are sorted first. Sorting only
+    // changes the pairs of those, so the added ones don't get in the way.
+    for (int i = 0; i < 2; i++)
+        sortEndpoints(sap, i);
+
+    if (sap->num_added > 0)
+        insertAddedProxies(sap);
+
+    for (int i = 0; i < sap->num_pairs; i++) {
+        const pairT* pair = &sap->pairs[i];
+        int          a    = pair->proxies[0];
+        int          b    = pair->proxies[1];
+
+        bodyPairT body_pair = { min(a, b), max(a, b) };
+
+        arrayAdd(pairs, &body_pair);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef sweepandprune_h_
+#define sweepandprune_h_
+
+/*------------------------------------------------
+ * INCLUDES
+ *----------------------------------------------*/
+
+#include "base/array.h"
+#include "base/common.h"
+#include "math/aabb.h"
+#include "physics/physics.h"
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct sweepAndPruneT sweepAndPruneT;
+
+/*------------------------------------------------
+ * FUNCTIONS
+ *----------------------------------------------*/
+
+sweepAndPruneT* sapNew(void);
+void sapFree(sweepAndPruneT* sap);
+
+// Adds a proxy for the body with the specified id. Proxies are identified by
+// body id. The body's AABB is not known until the next call to
+// sapUpdateProxy(), so the proxy is sorted in with the others on the next call
+// to sapFindPairs(). Adding many proxies at once costs about as much as one
+// sort of the whole lot.
+void sapAddProxy(sweepAndPruneT* sap, int body);
+
+// Removes the proxy for the body with the specified id. The proxy of the body
+// with the highest id takes over the id, the same way bodies are moved when
+// they are removed from a world. Only touches the pairs and endpoints of the
+// two proxies.
+void sapRemoveProxy(sweepAndPruneT* sap, int body);
+
+void sapUpdateProxy(sweepAndPruneT* sap, int body, const aabbT* aabb);
+
+// Sorts the endpoints after the proxies have been updated, updates the set of
+// pairs whose AABBs overlap and adds them to the specified array (of
+// bodyPairT), with the lower body id first.
+void sapFindPairs(sweepAndPruneT* sap, arrayT* pairs);
+
+#endif // sweepandprune_h_
@@ -7,42 +7,220 @@
 
 #include "base/common.h"
 #include "base/debug.h"
+#include "base/jobs.h"
 #include "math/aabb.h"
 #include "math/integrate.h"
 #include "math/matrix.h"
 #include "math/shape.h"
+#include "math/trig.h"
 #include "physics/body.h"
+#include "physics/spatialhash.h"
+#include "physics/sweepandprune.h"
 
+#include <float.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Specifies the integration function to use for integrating positions,
-// velocities, etc.
-#define IntegrateFn rk4Integrate
+// The maximum number of impacts handled in a single call to worldStep(). Any
+// impacts after that are left to the discrete collision pass at the end of
+// the step.
+#define MaxImpacts 32
 
-// The maximum number of subdivides to do for a single step attempt in the
-// worldStep() function.
-#define MaxSubdivs 8
+// The maximum number of conservative advancement iterations when looking for
+// the time of impact of a pair.
+#define MaxToiIterations 20
+
+// Bodies are moved to this distance from each other at their time of impact,
+// so that the contact can be found without the bodies overlapping.
+#define ToiTarget (0.005f)
+
+// How close to ToiTarget the bodies must get before we consider them touching.
+#define ToiTolerance (0.25f*ToiTarget)
+
+// Bodies moving slower than this (in units per second and radians per second)
+// for TimeToSleep seconds are put to sleep, together with every body they are
+// touching.
+#define LinearSleepTolerance  (0.01f)
+#define AngularSleepTolerance (0.035f)
+#define TimeToSleep           (0.5f)
+
+// The world bounds used until worldSetBounds() is called.
+#define DefaultWorldMinX (-7.0f)
+#define DefaultWorldMaxX ( 7.0f)
+#define DefaultWorldMinY (-5.0f)
+#define DefaultWorldMaxY ( 5.0f)
+
+// The initial capacity of the world body arrays.
+#define InitialBodyCapacity 64
+
+// The number of iterations the contact solver runs each step.
+#define ContactIterations 10
+
+// How much of the penetration between bodies we correct each step, and how
+// much penetration we allow without correcting it. Allowing a little bit keeps
+// resting contacts from jittering. Bodies are never moved more than
+// MaxCorrection in a single step.
+#define BiasFactor    (0.2f)
+#define LinearSlop    (0.01f)
+#define MaxCorrection (0.2f)
+
+// The friction coefficient used for all contacts.
+#define Friction (0.4f)
+
+// Bodies hitting each other slower than this don't bounce. Keeps resting
+// contacts from bouncing forever.
+#define RestitutionThreshold (0.1f)
+
+// Parallel loops are not split into ranges smaller than this.
+#define MinJobSize 32
 
 // This struct is used as a return value for some functions. I think it's ok
 // performance-wise. I believe that the ABI specifies that it will be returned
 // on the caller's stack due to its size.
 typedef struct {
-    bool exists;
-    vec2 normal;
-    vec2 contact;
-    bodyT* a;
-    bodyT* b;
+    bool   exists;
+    vec2   normal;    // Collision normal, pointing towards body a.
+    vec2   contact;   // Average contact point, in world space.
+    vec2   points[2]; // Contact points, in world space.
+    float  depths[2]; // Penetration depth at each contact point.
+    int    ids[2];    // Identifies each contact point between steps.
+    int    num_points;
+    float  depth;     // Penetration depth.
+    int    a;         // Body ids.
+    int    b;         // -1 for collisions with the world bounds.
 } collisionT;
 
+typedef struct {
+    int   a; // Body ids.
+    int   b; // -1 for impacts with the world bounds.
+    float t; // Time of impact, as a fraction of the step. 1 if none.
+} impactT;
+
+// Passed to the jobs that run the parallel parts of worldStep().
+typedef struct {
+    worldT*            world;
+    int                batch_size;
+    const bodyStatesT* state;
+    bool               sweep;
+    float              dt;
+} stepJobT;
+
 /*------------------------------------------------
  * FUNCTIONS
  *----------------------------------------------*/
 
+static void growBodyArrays(worldT* world, int max_bodies) {
+    #define grow(p) p = realloc(p, max_bodies * sizeof(*p))
+
+    grow(world->state.x ); grow(world->prev_state.x );
+    grow(world->state.y ); grow(world->prev_state.y );
+    grow(world->state.o ); grow(world->prev_state.o );
+    grow(world->state.vx); grow(world->prev_state.vx);
+    grow(world->state.vy); grow(world->prev_state.vy);
+    grow(world->state.w ); grow(world->prev_state.w );
+
+    grow(world->start_x);
+    grow(world->start_y);
+    grow(world->start_o);
+
+    grow(world->ax);
+    grow(world->ay);
+    grow(world->t );
+
+    grow(world->inv_mass   );
+    grow(world->inv_inertia);
+    grow(world->restitution);
+
+    grow(world->cx);
+    grow(world->cy);
+    grow(world->hx);
+    grow(world->hy);
+
+    grow(world->awake       );
+    grow(world->sleep_time  );
+    grow(world->island      );
+    grow(world->island_awake);
+
+    grow(world->alpha    );
+    grow(world->ccd      );
+    grow(world->aabbs    );
+    grow(world->force_models);
+    grow(world->force_params);
+    grow(world->deriv_fns);
+    grow(world->force_bodies);
+    grow(world->proxies  );
+    grow(world->bodies   );
+
+    #undef grow
+
+    world->max_bodies = max_bodies;
+}
+
+static void freeBodyArrays(worldT* world) {
+    free(world->state.x ); free(world->prev_state.x );
+    free(world->state.y ); free(world->prev_state.y );
+    free(world->state.o ); free(world->prev_state.o );
+    free(world->state.vx); free(world->prev_state.vx);
+    free(world->state.vy); free(world->prev_state.vy);
+    free(world->state.w ); free(world->prev_state.w );
+
+    free(world->start_x);
+    free(world->start_y);
+    free(world->start_o);
+
+    free(world->ax);
+    free(world->ay);
+    free(world->t );
+
+    free(world->inv_mass   );
+    free(world->inv_inertia);
+    free(world->restitution);
+
+    free(world->cx);
+    free(world->cy);
+    free(world->hx);
+    free(world->hy);
+
+    free(world->awake       );
+    free(world->sleep_time  );
+    free(world->island      );
+    free(world->island_awake);
+
+    free(world->alpha    );
+    free(world->ccd      );
+    free(world->aabbs    );
+    free(world->force_models);
+    free(world->force_params);
+    free(world->deriv_fns);
+    free(world->force_bodies);
+    free(world->proxies  );
+    free(world->bodies   );
+}
+
 worldT* worldAlloc(void) {
     worldT* world = calloc(1, sizeof(worldT));
 
-    world->collisions = arrayNew(sizeof(collisionT));
+    world->broadphase    = SpatialHashBroadphase;
+    world->bounds        = (aabbT) {
+        { .x = DefaultWorldMinX, .y = DefaultWorldMinY },
+        { .x = DefaultWorldMaxX, .y = DefaultWorldMaxY }
+    };
+    world->bounds_mode   = SolidBounds;
+    world->spatial_hash  = spatialHashNew();
+    world->sap           = sapNew();
+    world->pairs         = arrayNew(sizeof(bodyPairT));
+    world->impacts       = arrayNew(sizeof(impactT));
+    world->collisions    = arrayNew(sizeof(collisionT));
+    world->contacts      = arrayNew(sizeof(contactT));
+    world->prev_contacts = arrayNew(sizeof(contactT));
+    world->fields        = arrayNew(sizeof(forceFieldT*));
+    world->tree          = aabbTreeNew();
+
+    for (int i = 0; i < MaxJobRanges; i++) {
+        world->range_pairs     [i] = arrayNew(sizeof(bodyPairT));
+        world->range_collisions[i] = arrayNew(sizeof(collisionT));
+    }
 
     return (world);
 }
@@ -62,157 +240,560 @@ void worldFree(worldT* world) {
     if (!world)
         return;
 
+    if (world->spatial_hash) {
+        spatialHashFree(world->spatial_hash);
+        world->spatial_hash = NULL;
+    }
+
+    if (world->sap) {
+        sapFree(world->sap);
+        world->sap = NULL;
+    }
+
+    if (world->pairs) {
+        arrayFree(world->pairs);
+        world->pairs = NULL;
+    }
+
+    if (world->impacts) {
+        arrayFree(world->impacts);
+        world->impacts = NULL;
+    }
+
     if (world->collisions) {
         arrayFree(world->collisions);
         world->collisions = NULL;
     }
 
+    if (world->contacts) {
+        arrayFree(world->contacts);
+        world->contacts = NULL;
+    }
+
+    if (world->prev_contacts) {
+        arrayFree(world->prev_contacts);
+        world->prev_contacts = NULL;
+    }
+
+    freeForceFields(world);
+
+    aabbTreeFree(world->tree);
+    world->tree = NULL;
+
+    for (int i = 0; i < MaxJobRanges; i++) {
+        arrayFree(world->range_pairs     [i]);
+        arrayFree(world->range_collisions[i]);
+    }
+
+    freeBodyArrays(world);
+
     free(world);
 }
 
 void worldAddBody(worldT* world, bodyT* body) {
     assert(body->world == NULL);
 
+    int i = world->num_bodies;
+    if (i >= world->max_bodies)
+        growBodyArrays(world, max(InitialBodyCapacity, 2*world->max_bodies));
+
+    world->num_bodies++;
+
+    // From here on, the body state lives in the world body arrays.
+    const bodyStateT* s = &body->state;
+    float state[6] = { s->x.x, s->x.y, s->o, s->v.x, s->v.y, s->w };
+
+    storeBodyState(&world->state     , i, state);
+    storeBodyState(&world->prev_state, i, state);
+
+    world->start_x[i] = s->x.x;
+    world->start_y[i] = s->x.y;
+    world->start_o[i] = s->o;
+
+    world->ax[i] = s->a.x;
+    world->ay[i] = s->a.y;
+    world->t [i] = s->t;
+
+    world->inv_mass   [i] = body->inv_mass;
+    world->inv_inertia[i] = body->inv_inertia;
+    world->restitution[i] = body->restitution;
+
+    world->awake     [i] = true;
+    world->sleep_time[i] = 0.0f;
+    world->ccd       [i] = body->ccd;
+
+    aabbT aabb = shapeAABB(body->shape);
+    world->cx[i] = 0.5f*(aabb.min.x+aabb.max.x);
+    world->cy[i] = 0.5f*(aabb.min.y+aabb.max.y);
+    world->hx[i] = 0.5f*(aabb.max.x-aabb.min.x);
+    world->hy[i] = 0.5f*(aabb.max.y-aabb.min.y);
+
+    world->force_models[i] = body->force_model;
+    world->force_params[i] = body->force_params;
+    world->deriv_fns   [i] = body->deriv_fn;
+    world->bodies      [i] = body;
+
     body->world = world;
+    body->id    = i;
+
+    // Takes care of the mass and sleep state of static bodies.
+    bodySetType(body, body->type);
 
-    if (world->bodies)
-        world->bodies->prev = body;
+    sapAddProxy(world->sap, i);
 
-    body->next = world->bodies;
-    world->bodies = body;
+    aabbT box = findBodyAABB(world, &world->state, i);
+    world->proxies[i] = aabbTreeInsert(world->tree, &box, i);
 }
 
-static void findBodyBodyContacts(bodyT* a, bodyT* b) {
-    for (int i0 = 0; i0 < a->shape->num_points; i0++) {
-        int i1 = (i0+1) % a->shape->num_points;
+static void moveBody(worldT* world, int from, int to) {
+    // Moves a body to another slot in the body arrays. The scratch arrays are
+    // filled in every step, so they are left alone.
+    #define move(p) p[to] = p[from]
+
+    move(world->state.x ); move(world->prev_state.x );
+    move(world->state.y ); move(world->prev_state.y );
+    move(world->state.o ); move(world->prev_state.o );
+    move(world->state.vx); move(world->prev_state.vx);
+    move(world->state.vy); move(world->prev_state.vy);
+    move(world->state.w ); move(world->prev_state.w );
+
+    move(world->start_x);
+    move(world->start_y);
+    move(world->start_o);
+
+    move(world->ax);
+    move(world->ay);
+    move(world->t );
+
+    move(world->inv_mass   );
+    move(world->inv_inertia);
+    move(world->restitution);
+
+    move(world->cx);
+    move(world->cy);
+    move(world->hx);
+    move(world->hy);
+
+    move(world->awake     );
+    move(world->sleep_time);
+
+    move(world->alpha    );
+    move(world->ccd      );
+    move(world->aabbs    );
+    move(world->force_models);
+    move(world->force_params);
+    move(world->deriv_fns);
+    move(world->proxies  );
+    move(world->bodies   );
+
+    #undef move
+
+    world->bodies[to]->id = to;
+}
 
-        vec2 p = a->shape->points[i0];
-        vec2 q = a->shape->points[i1];
+static void removeBodyContacts(worldT* world, int body, int last) {
+    // Drops the contacts of a removed body and renames the contacts of the
+    // body that takes over its slot, keeping the rest for warm starting.
+    arrayT* contacts = world->contacts;
+    int     n        = 0;
 
-        for (int j = 0; j < b->shape->num_points; j++) {
-        }
+    for (int i = 0; i < arrayLength(contacts); i++) {
+        contactT c = *(contactT*)arrayGet(contacts, i);
+
+        if (c.a == body || c.b == body)
+            continue;
+
+        if (c.a == last) c.a = body;
+        if (c.b == last) c.b = body;
+
+        *(contactT*)arrayGet(contacts, n++) = c;
     }
+
+    while (arrayLength(contacts) > n)
+        arrayRemove(contacts, arrayLength(contacts)-1);
 }
 
-static inline bool pointInsideAABB(const vec2* p, const aabbT* aabb) {
-    if ((p->x >= aabb->min.x)
-     && (p->x  < aabb->max.x)
-     && (p->y >= aabb->min.y)
-     && (p->y  < aabb->max.y))
-    {
-        return (true);
+void worldRemoveBody(worldT* world, bodyT* body) {
+    assert(body->world == world);
+
+    int          i    = body->id;
+    int          last = world->num_bodies-1;
+    bodyStatesT* s    = &world->state;
+
+    // From here on, the body state lives in the body again.
+    body->state = (bodyStateT) {
+        .x = { .x = s->x [i], .y = s->y [i] }, .o = s->o[i],
+        .v = { .x = s->vx[i], .y = s->vy[i] }, .w = s->w[i],
+        .a = { .x = world->ax[i], .y = world->ay[i] }, .t = world->t[i]
+    };
+
+    aabbTreeRemove(world->tree, world->proxies[i]);
+    sapRemoveProxy(world->sap, i);
+    removeBodyContacts(world, i, last);
+
+    if (i != last) {
+        moveBody(world, last, i);
+
+        // Tree proxies know their body by id, so the moved body gets a new
+        // one.
+        aabbT aabb = findBodyAABB(world, s, i);
+        aabbTreeRemove(world->tree, world->proxies[i]);
+        world->proxies[i] = aabbTreeInsert(world->tree, &aabb, i);
     }
 
-    return (false);
+    world->num_bodies--;
+
+    body->world = NULL;
+    body->id    = -1;
 }
 
-static collisionT findBodyBodyCollision(worldT* world, bodyT* a, bodyT* b) {
-    collisionT c = { 0 };
+void worldMoveProxy(worldT* world, int body) {
+    aabbT aabb = findBodyAABB(world, &world->state, body);
+    aabbTreeMove(world->tree, world->proxies[body], &aabb);
+}
 
-    // @To-do: Implement this in a sane manner.
-    return (c);
+void worldWakeBody(worldT* world, int body) {
+    if (world->bodies[body]->type == StaticBody)
+        return;
 
-    c.exists = false;
+    world->awake     [body] = true;
+    world->sleep_time[body] = 0.0f;
+}
 
-    // First, we do an AABB collision test since it's faster.
+void worldSetBroadphase(worldT* world, broadphaseT broadphase) {
+    world->broadphase = broadphase;
+}
 
-    aabbT a_aabb = bodyRotatedAABB(a);
-    aabbT b_aabb = bodyRotatedAABB(b);
+void worldSetBounds(worldT* world, aabbT bounds, boundsModeT mode) {
+    assert(bounds.min.x < bounds.max.x && bounds.min.y < bounds.max.y);
 
-    if (a_aabb.max.x < b_aabb.min.x
-     || a_aabb.min.x > b_aabb.max.x
-     || a_aabb.max.y < b_aabb.min.y
-     || a_aabb.min.y > b_aabb.max.y)
-    {
-        // Definitely not a collision, so we can return here.
-        return (c);
+    world->bounds      = bounds;
+    world->bounds_mode = mode;
+}
+
+aabbT worldBounds(const worldT* world) {
+    return (world->bounds);
+}
+
+void worldSetJobSystem(worldT* world, jobSystemT* jobs) {
+    world->jobs = jobs;
+}
+
+static int jobBatchSize(int n) {
+    // Picks a batch size that splits n elements into at most MaxJobRanges
+    // ranges, so that each range can have its own result array.
+    return (max(MinJobSize, (n + MaxJobRanges - 1) / MaxJobRanges));
+}
+
+static void parallelFor(worldT* world, jobFnT fn, stepJobT* job, int n) {
+    // Runs the job over [0, n) on the job system if we have one. The ranges
+    // are the same whether we run in parallel or not, except that without a
+    // job system everything ends up in range zero. Either way, results merged
+    // in range order come out the same.
+    job->world      = world;
+    job->batch_size = jobBatchSize(n);
+
+    if (world->jobs)
+        jobsParallelFor(world->jobs, fn, job, n, job->batch_size);
+    else if (n > 0)
+        fn(job, 0, n);
+}
+
+static void mergeRanges(arrayT* dst, arrayT** ranges) {
+    for (int i = 0; i < MaxJobRanges; i++) {
+        arrayT* range = ranges[i];
+
+        for (int j = 0; j < arrayLength(range); j++)
+            arrayAdd(dst, arrayGet(range, j));
+
+        arrayClear(range);
     }
+}
 
-    trace("possible collision");
+void transformShape(const shapeT* shape, float x, float y, float o,
+                    vec2* points, vec2* normals)
+{
+    vec2 pos = { .x = x, .y = y };
 
-    // The AABBs are colliding, so there might be a collision.
+    mat2x2 r;
+    mat_rot_z(o, &r);
 
-    // @To-do: I'm a lazy bastard and decided to only implement fine collision
-    //         resolution for rectangles. Boo-hoo!
-    
-    // Require exactly 4 points and assume they represent a rectangle.
-    assert(a->shape->num_points == 4);
-    assert(b->shape->num_points == 4);
+    for (int i = 0; i < shape->num_points; i++) {
+        vec_mat_mul(&shape->points[i] , &r, &points[i] );
+        vec_add    (&points[i], &pos, &points[i]);
+        vec_mat_mul(&shape->normals[i], &r, &normals[i]);
+    }
+}
 
-    aabbT aabb = shapeAABB(a->shape);
+aabbT findBodyAABB(const worldT* world, const bodyStatesT* state, int body) {
+    // We rotate the shape AABB instead of each shape point, which gives us a
+    // slightly bigger box for non-rectangular shapes, but is much cheaper.
+    float s, c;
+    trig_sincos(state->o[body], &s, &c);
 
-    mat2x2 ra, rb;
-    mat_rot_z(-a->state.o, &ra);
-    mat_rot_z(b->state.o, &rb);
+    float cx = world->cx[body];
+    float cy = world->cy[body];
+    float hx = world->hx[body];
+    float hy = world->hy[body];
 
-    int num_contacts = 0;
+    float px = state->x[body] + c*cx - s*cy;
+    float py = state->y[body] + s*cx + c*cy;
 
-    for (int i = 0; i < 4; i++) {
-        vec2 p = b->shape->points[i];
+    float ex = fabsf(c)*hx + fabsf(s)*hy;
+    float ey = fabsf(s)*hx + fabsf(c)*hy;
 
-        vec_mat_mul(&p, &rb, &p);
-        vec_add    (&p, &b->state.x, &p);
-        vec_sub    (&p, &a->state.x, &p);
-        vec_mat_mul(&p, &ra, &p);
+    return ((aabbT) { { .x = px-ex, .y = py-ey }, { .x = px+ex, .y = py+ey } });
+}
 
-        if (pointInsideAABB(&p, &aabb)) {
-            // We should probably clip here but I trust that the binary search
-            // for time-of-collision is accurate enough that we don't need to.
+static float findMaxSeparation(const vec2* a_points, const vec2* a_normals,
+                               int a_n, const vec2* b_points, int b_n,
+                               float early_out, int* edge)
+{
+    // For each edge of polygon a, we find the point of polygon b that is the
+    // furthest behind it. The edge with the largest such distance is the best
+    // separating axis. If the distance is positive, the polygons are not
+    // overlapping.
 
-            c.exists = true;
+    float max_sep = -FLT_MAX;
 
-            // Point p is in local space (body a frame of reference).
-            vec_add(&p, &c.contact, &c.contact);
+    for (int i = 0; i < a_n; i++) {
+        const vec2* n = &a_normals[i];
+        float min_sep = FLT_MAX;
 
+        for (int j = 0; j < b_n; j++) {
+            vec2 d;
+            vec_sub(&b_points[j], &a_points[i], &d);
 
-            num_contacts++;
+            min_sep = min(min_sep, vec_dot(n, &d));
+        }
+
+        if (min_sep > max_sep) {
+            max_sep = min_sep;
+            *edge   = i;
+        }
+
+        // Early out as soon as we find a separating axis.
+        if (max_sep > early_out)
+            break;
+    }
+
+    return (max_sep);
+}
+
+static int clipSegment(const vec2* in, vec2* out, const vec2* n, float offset) {
+    // Clips the segment in[0]-in[1] against the half-plane dot(n, p) <= offset.
+
+    int num_out = 0;
+
+    float d0 = vec_dot(n, &in[0]) - offset;
+    float d1 = vec_dot(n, &in[1]) - offset;
+
+    if (d0 <= 0.0f) out[num_out++] = in[0];
+    if (d1 <= 0.0f) out[num_out++] = in[1];
+
+    if (d0*d1 < 0.0f) {
+        float t = d0 / (d0-d1);
+
+        out[num_out].x = in[0].x + t*(in[1].x-in[0].x);
+        out[num_out].y = in[0].y + t*(in[1].y-in[0].y);
+        num_out++;
+    }
+
+    return (num_out);
+}
+
+static collisionT findBodyBodyCollision(worldT* world, int a, int b,
+                                        float margin)
+{
+    // We use the separating axis theorem to find out if the two (convex)
+    // shapes are overlapping, then clip the incident edge against the
+    // reference edge to find the contact points. Shapes closer than margin
+    // are considered to be touching.
+    //     See http://www.dyn4j.org/2010/01/sat/ and Erin Catto's Box2D-Lite
+    // for more information.
+
+    collisionT c = { 0 };
+
+    vec2 a_points[ShapeMaxPoints], a_normals[ShapeMaxPoints];
+    vec2 b_points[ShapeMaxPoints], b_normals[ShapeMaxPoints];
+
+    int a_n = world->bodies[a]->shape->num_points;
+    int b_n = world->bodies[b]->shape->num_points;
+
+    const bodyStatesT* s = &world->state;
+
+    transformShape(world->bodies[a]->shape, s->x[a], s->y[a], s->o[a],
+                   a_points, a_normals);
+    transformShape(world->bodies[b]->shape, s->x[b], s->y[b], s->o[b],
+                   b_points, b_normals);
+
+    int   a_edge, b_edge;
+    float a_sep = findMaxSeparation(a_points, a_normals, a_n, b_points, b_n,
+                                    margin, &a_edge);
+    if (a_sep > margin)
+        return (c);
+
+    float b_sep = findMaxSeparation(b_points, b_normals, b_n, a_points, a_n,
+                                    margin, &b_edge);
+    if (b_sep > margin)
+        return (c);
+
+    // The reference face is the one with the least penetration. We prefer a
+    // over b unless b is clearly better, to keep the choice from flipping
+    // back and forth between frames.
+    bool flip = (b_sep > 0.98f*a_sep + 0.001f);
+
+    const vec2* ref_points = flip ? b_points  : a_points;
+    const vec2* ref_normal = flip ? &b_normals[b_edge] : &a_normals[a_edge];
+    const vec2* inc_points = flip ? a_points  : b_points;
+    const vec2* inc_normals= flip ? a_normals : b_normals;
+    int         ref_n      = flip ? b_n : a_n;
+    int         inc_n      = flip ? a_n : b_n;
+    int         ref_edge   = flip ? b_edge : a_edge;
+
+    // The incident edge is the edge on the other polygon that is the most
+    // anti-parallel to the reference edge.
+    int   inc_edge = 0;
+    float min_dot  = FLT_MAX;
+    for (int i = 0; i < inc_n; i++) {
+        float d = vec_dot(ref_normal, &inc_normals[i]);
+        if (d < min_dot) {
+            min_dot  = d;
+            inc_edge = i;
         }
     }
 
-    //assert(!c.exists);
-    c.normal = (vec2) {- 0.8f, -0.7f };
+    vec2 inc[2] = { inc_points[inc_edge], inc_points[(inc_edge+1) % inc_n] };
+
+    vec2 r1 = ref_points[ref_edge];
+    vec2 r2 = ref_points[(ref_edge+1) % ref_n];
 
-    c.a = a;
-    c.b = b;
+    vec2 t;
+    vec_sub      (&r2, &r1, &t);
+    vec_normalize(&t , &t);
+
+    // Clip the incident edge against the side planes of the reference edge.
+    vec2 clip1[3], clip2[3], neg_t = { .x = -t.x, .y = -t.y };
+
+    if (clipSegment(inc, clip1, &neg_t, -vec_dot(&t, &r1)) < 2)
+        return (c);
+
+    if (clipSegment(clip1, clip2, &t, vec_dot(&t, &r2)) < 2)
+        return (c);
+
+    // Keep the points that are behind the reference face.
+    float ref_offset = vec_dot(ref_normal, &r1);
+
+    for (int i = 0; i < 2; i++) {
+        float sep = vec_dot(ref_normal, &clip2[i]) - ref_offset;
+
+        if (sep <= margin) {
+            // The contact point id is made up of the edges it was found
+            // from, which stay the same while the bodies stay in contact.
+            c.ids   [c.num_points] = (flip<<17) | (ref_edge<<9)
+                                   | (inc_edge<<1) | i;
+            c.depths[c.num_points] = -sep;
+            c.points[c.num_points++] = clip2[i];
+            c.depth = max(c.depth, -sep);
+            vec_add(&clip2[i], &c.contact, &c.contact);
+        }
+    }
+
+    if (c.num_points == 0)
+        return (c);
+
+    vec_scale(&c.contact, 1.0f/c.num_points, &c.contact);
+
+    // The normal should point towards body a, i.e. in the direction in which
+    // body a should be pushed.
+    if (flip) c.normal = *ref_normal;
+    else      c.normal = (vec2) { .x = -ref_normal->x, .y = -ref_normal->y };
+
+    c.exists = true;
+    c.a      = a;
+    c.b      = b;
 
     return (c);
 }
 
-static collisionT findBodyWorldCollision(worldT* world, bodyT* body) {
+static collisionT findBodyWorldCollision(worldT* world, int body,
+                                         float margin)
+{
     // We find the number of contacts that the object is making with the
     // world edges and then average them into a single contact point, at
     // which we then apply the collision impulse vector. Seems to work fine.
+    // Points closer to the edges than margin count as contacts. The contact
+    // solver gets the two deepest points, so that bodies resting on an edge
+    // don't tip over.
 
     collisionT c = { 0 };
 
     c.a      = body;
+    c.b      = -1;
     c.exists = false;
 
+    // Most bodies are nowhere near the edges, so we check the body AABB before
+    // transforming the shape points.
+    aabbT aabb = findBodyAABB(world, &world->state, body);
+    if (aabbContains(&world->bounds, &aabb, margin))
+        return (c);
+
+    const aabbT* bounds = &world->bounds;
+
     int num_contacts = 0;
 
+    const shapeT* shape = world->bodies[body]->shape;
+
+    vec2 pos = { .x = world->state.x[body], .y = world->state.y[body] };
+
     mat2x2 rotation;
-    mat_rot_z(body->state.o, &rotation);
+    mat_rot_z(world->state.o[body], &rotation);
 
-    for (int i = 0; i < body->shape->num_points; i++) {
+    for (int i = 0; i < shape->num_points; i++) {
         vec2 local_pos, world_pos;
-        vec_mat_mul(&body->shape->points[i], &rotation , &local_pos);
-        vec_add    (&body->state.x         , &local_pos, &world_pos);
+        vec_mat_mul(&shape->points[i], &rotation , &local_pos);
+        vec_add    (&pos             , &local_pos, &world_pos);
+
+        float dx0 = bounds->min.x - world_pos.x;
+        float dx1 = world_pos.x - bounds->max.x;
+        float dy0 = bounds->min.y - world_pos.y;
+        float dy1 = world_pos.y - bounds->max.y;
+
+        if (dx0 > -margin) c.normal.x += 1.0f;
+        if (dx1 > -margin) c.normal.x -= 1.0f;
+        if (dy0 > -margin) c.normal.y += 1.0f;
+        if (dy1 > -margin) c.normal.y -= 1.0f;
 
-        bool coll = false;
-        // @To-do: World bounds should not be specified here, duh.
-        if (world_pos.x < -7.0f) { coll = true; c.normal.x += 1.0f; }
-        if (world_pos.x >  7.0f) { coll = true; c.normal.x -= 1.0f; }
-        if (world_pos.y < -5.0f) { coll = true; c.normal.y += 1.0f; }
-        if (world_pos.y >  5.0f) { coll = true; c.normal.y -= 1.0f; }
+        float depth = max(max(dx0, dx1), max(dy0, dy1));
 
-        if (coll) {
+        if (depth > -margin) {
             num_contacts++;
             vec_add(&local_pos, &c.contact, &c.contact);
+            c.depth = max(c.depth, depth);
+
+            // Keep the points sorted by depth, deepest first.
+            int j = min(c.num_points, 1);
+            if (c.num_points < 2)
+                c.num_points++;
+            else if (depth <= c.depths[1])
+                continue;
+
+            if (j == 1 && depth > c.depths[0]) {
+                c.points[1] = c.points[0];
+                c.depths[1] = c.depths[0];
+                c.ids   [1] = c.ids   [0];
+                j = 0;
+            }
+
+            vec_add(&pos, &local_pos, &c.points[j]);
+            c.depths[j] = depth;
+            c.ids   [j] = i;
         }
     }
 
     if (num_contacts > 0) {
         vec_scale    (&c.contact, 1.0f/num_contacts, &c.contact);
+        vec_add      (&c.contact, &pos             , &c.contact);
         vec_normalize(&c.normal                    , &c.normal );
 
         c.exists = true;
@@ -221,117 +802,989 @@ static collisionT findBodyWorldCollision(worldT* world, bodyT* body) {
     return (c);
 }
 
+static void updateAABBsJob(void* data, int begin, int end) {
+    // Finds the world space AABBs of the bodies in the specified state. If
+    // sweep is set, the current AABBs of bodies with continuous collision
+    // detection are grown to also cover them in that state, and the other
+    // bodies (which aren't swept) were skipped on the first pass.
+
+    const stepJobT* job   = data;
+    const worldT*   world = job->world;
+    const bool*     ccd   = world->ccd;
+    aabbT*          aabbs = world->aabbs;
+
+    for (int i = begin; i < end; i++) {
+        if (!job->sweep && !ccd[i])
+            continue;
+
+        aabbT aabb = findBodyAABB(world, job->state, i);
+
+        if (job->sweep && ccd[i]) {
+            aabbs[i].min.x = min(aabbs[i].min.x, aabb.min.x);
+            aabbs[i].min.y = min(aabbs[i].min.y, aabb.min.y);
+            aabbs[i].max.x = max(aabbs[i].max.x, aabb.max.x);
+            aabbs[i].max.y = max(aabbs[i].max.y, aabb.max.y);
+        }
+        else {
+            aabbs[i] = aabb;
+        }
+    }
+}
+
+static void updateAABBs(worldT* world, const bodyStatesT* state, bool sweep) {
+    stepJobT job = { .state = state, .sweep = sweep };
+    parallelFor(world, updateAABBsJob, &job, world->num_bodies);
+}
+
+static void findPairsJob(void* data, int begin, int end) {
+    const stepJobT* job    = data;
+    arrayT*         result = job->world->range_pairs[begin / job->batch_size];
+
+    spatialHashFindPairsInBuckets(job->world->spatial_hash, begin, end, result);
+}
+
+static int comparePairs(const void* p1, const void* p2) {
+    const bodyPairT* a = p1;
+    const bodyPairT* b = p2;
+
+    if (a->a != b->a) return ((a->a < b->a) ? -1 : 1);
+    if (a->b != b->b) return ((a->b < b->b) ? -1 : 1);
+
+    return (0);
+}
+
+static void findPairs(worldT* world) {
+    // Broad-phase: we feed the current body AABBs to the broad-phase and let
+    // it figure out which bodies might be colliding. Only those pairs are
+    // passed on to the (expensive) narrow-phase.
+
+    arrayClear(world->pairs);
+
+    if (world->broadphase == SweepAndPruneBroadphase) {
+        // The sweep-and-prune keeps its endpoints and overlapping pairs
+        // between calls, so we only need to tell it where the bodies are now.
+        // Sorting the endpoints doesn't split up well, so this one stays on a
+        // single thread.
+        for (int i = 0; i < world->num_bodies; i++)
+            sapUpdateProxy(world->sap, i, &world->aabbs[i]);
+
+        sapFindPairs(world->sap, world->pairs);
+
+        // The order of the pairs depends on the history of the pair set, so
+        // we sort them. Otherwise, a world restored from a snapshot could
+        // resolve its collisions in a different order than the first time.
+        int num_pairs = arrayLength(world->pairs);
+        if (num_pairs > 1)
+            qsort(arrayGet(world->pairs, 0), num_pairs, sizeof(bodyPairT),
+                  comparePairs);
+
+        return;
+    }
+
+    spatialHashClear(world->spatial_hash);
+
+    for (int i = 0; i < world->num_bodies; i++)
+        spatialHashInsert(world->spatial_hash, i, &world->aabbs[i]);
+
+    // The cells are built on one thread, then the buckets are searched for
+    // pairs in parallel.
+    spatialHashBuild(world->spatial_hash);
+
+    stepJobT job = { 0 };
+    parallelFor(world, findPairsJob, &job,
+                spatialHashNumBuckets(world->spatial_hash));
+
+    mergeRanges(world->pairs, world->range_pairs);
+}
+
+static void findWorldCollisionsJob(void* data, int begin, int end) {
+    const stepJobT* job    = data;
+    worldT*         world  = job->world;
+    arrayT*         result = world->range_collisions[begin / job->batch_size];
+
+    for (int i = begin; i < end; i++) {
+        if (!world->awake[i])
+            continue;
+
+        collisionT c = findBodyWorldCollision(world, i, 0.0f);
+        if (c.exists)
+            arrayAdd(result, &c);
+    }
+}
+
+static void findPairCollisionsJob(void* data, int begin, int end) {
+    const stepJobT* job    = data;
+    worldT*         world  = job->world;
+    arrayT*         result = world->range_collisions[begin / job->batch_size];
+    const bool*     awake  = world->awake;
+
+    for (int i = begin; i < end; i++) {
+        bodyPairT* pair = arrayGet(world->pairs, i);
+
+        if (!awake[pair->a] && !awake[pair->b])
+            continue;
+
+        collisionT c = findBodyBodyCollision(world, pair->a, pair->b, 0.0f);
+        if (c.exists)
+            arrayAdd(result, &c);
+    }
+}
+
 static int findCollisions(worldT* world) {
+    // Discrete collision pass over the broad-phase pairs. The pairs were found
+    // with the swept AABBs, so they cover the bodies wherever they are now.
+    // The collisions come out in the same order no matter how the work is
+    // split up, so they are resolved the same way every time.
     arrayClear(world->collisions);
 
-    bodyT* body = world->bodies;
-    while (body) {
-        collisionT c = findBodyWorldCollision(world, body);
-        if (c.exists)
-            arrayAdd(world->collisions, &c);
+    stepJobT job = { 0 };
+
+    if (world->bounds_mode == SolidBounds) {
+        parallelFor(world, findWorldCollisionsJob, &job, world->num_bodies);
+        mergeRanges(world->collisions, world->range_collisions);
+    }
+
+    parallelFor(world, findPairCollisionsJob, &job,
+                arrayLength(world->pairs));
+    mergeRanges(world->collisions, world->range_collisions);
+
+    return arrayLength(world->collisions);
+}
+
+static vec2 pointVelocity(const worldT* world, int body, const vec2* r) {
+    // The velocity of a point on the body, at offset r from its center.
+    vec2 v;
+
+    vec_perp (r , &v);
+    vec_scale(&v, world->state.w[body], &v);
+
+    v.x += world->state.vx[body];
+    v.y += world->state.vy[body];
+
+    return (v);
+}
+
+static void applyImpulse(worldT* world, int body, const vec2* i,
+                         const vec2* r)
+{
+    float inv_mass = world->inv_mass[body];
+
+    world->state.vx[body] += i->x * inv_mass;
+    world->state.vy[body] += i->y * inv_mass;
+    world->state.w [body] += vec_perp_dot(r, i) * world->inv_inertia[body];
+
+    // Sleeping bodies wake up when something hits them.
+    if (!world->awake[body] && (i->x != 0.0f || i->y != 0.0f))
+        worldWakeBody(world, body);
+}
+
+static void resolveCollision(worldT* world, const collisionT* c) {
+    int a = c->a;
+    int b = c->b;
+
+    vec2 a_pos = { .x = world->state.x[a], .y = world->state.y[a] };
+
+    vec2 ra, rb = { 0 }, v, vb = { 0 };
+    vec_sub(&c->contact, &a_pos, &ra);
+    v = pointVelocity(world, a, &ra);
+
+    if (b >= 0) {
+        vec2 b_pos = { .x = world->state.x[b], .y = world->state.y[b] };
+
+        vec_sub(&c->contact, &b_pos, &rb);
+        vb = pointVelocity(world, b, &rb);
+    }
+
+    // Relative velocity at the contact point, along the normal.
+    vec_sub(&v, &vb, &v);
+    float vn = vec_dot(&v, &c->normal);
+
+    // The bodies are already moving apart.
+    if (vn > 0.0f)
+        return;
+
+    float ra_n = vec_perp_dot(&ra, &c->normal);
+    float rb_n = vec_perp_dot(&rb, &c->normal);
+
+    float k = world->inv_mass[a] + ra_n*ra_n*world->inv_inertia[a];
+    float e = world->restitution[a];
+
+    if (b >= 0) {
+        k += world->inv_mass[b] + rb_n*rb_n*world->inv_inertia[b];
+        e  = min(e, world->restitution[b]);
+    }
 
+    float j = -(1.0f + e)*vn / k;
 
-        bodyT* other_body = world->bodies;
-        while (other_body) {
-            if (other_body == body) {
-                other_body = other_body->next;
+    vec2 impulse = (vec2) { .x = j*c->normal.x, .y = j*c->normal.y };
+    applyImpulse(world, a, &impulse, &ra);
+
+    if (b >= 0) {
+        vec_scale(&impulse, -1.0f, &impulse);
+        applyImpulse(world, b, &impulse, &rb);
+    }
+}
+
+static int compareContacts(const void* p1, const void* p2) {
+    const contactT* c1 = p1;
+    const contactT* c2 = p2;
+
+    if (c1->a  != c2->a ) return ((c1->a  < c2->a ) ? -1 : 1);
+    if (c1->b  != c2->b ) return ((c1->b  < c2->b ) ? -1 : 1);
+    if (c1->id != c2->id) return ((c1->id < c2->id) ? -1 : 1);
+
+    return (0);
+}
+
+static void applyContactImpulse(worldT* world, const contactT* c, float pn,
+                                float pt)
+{
+    // Applies the normal impulse pn and the friction impulse pt.
+    vec2 t;
+    vec_perp(&c->normal, &t);
+
+    vec2 impulse = { .x = pn*c->normal.x + pt*t.x,
+                     .y = pn*c->normal.y + pt*t.y };
+    applyImpulse(world, c->a, &impulse, &c->ra);
+
+    if (c->b >= 0) {
+        vec_scale(&impulse, -1.0f, &impulse);
+        applyImpulse(world, c->b, &impulse, &c->rb);
+    }
+}
+
+static vec2 contactVelocity(const worldT* world, const contactT* c) {
+    // Velocity of body a relative to body b at the contact point.
+    vec2 v = pointVelocity(world, c->a, &c->ra);
+
+    if (c->b >= 0) {
+        vec2 vb = pointVelocity(world, c->b, &c->rb);
+        vec_sub(&v, &vb, &v);
+    }
+
+    return (v);
+}
+
+static float effectiveMass(const worldT* world, const contactT* c,
+                           const vec2* dir)
+{
+    // The inverse of how much the relative velocity along dir changes for a
+    // unit impulse along dir.
+    float ra_d = vec_perp_dot(&c->ra, dir);
+    float k    = world->inv_mass[c->a] + ra_d*ra_d*world->inv_inertia[c->a];
+
+    if (c->b >= 0) {
+        float rb_d = vec_perp_dot(&c->rb, dir);
+        k += world->inv_mass[c->b] + rb_d*rb_d*world->inv_inertia[c->b];
+    }
+
+    return ((k > 0.0f) ? 1.0f/k : 0.0f);
+}
+
+static void prepareContacts(worldT* world) {
+    // Turns the collisions into contacts, picks up the accumulated impulses
+    // from last step's contacts and applies them right away. Most contacts
+    // stick around for many steps, so the solver then only has to correct
+    // for whatever changed since last step.
+
+    arrayT* prev_contacts = world->prev_contacts;
+    arrayT* contacts      = world->contacts;
+
+    world->prev_contacts = contacts;
+    world->contacts      = prev_contacts;
+
+    // Sorting the contacts lets us find last step's contacts with a binary
+    // search. The order doesn't depend on threading, so neither do results.
+    int       num_prev = arrayLength(world->prev_contacts);
+    contactT* prev     = (num_prev > 0) ? arrayGet(world->prev_contacts, 0)
+                                        : NULL;
+
+    if (num_prev > 1)
+        qsort(prev, num_prev, sizeof(contactT), compareContacts);
+
+    arrayClear(world->contacts);
+
+    for (int i = 0; i < arrayLength(world->collisions); i++) {
+        collisionT* col = arrayGet(world->collisions, i);
+
+        for (int j = 0; j < col->num_points; j++) {
+            contactT c = { 0 };
+
+            c.a      = col->a;
+            c.b      = col->b;
+            c.id     = col->ids[j];
+            c.normal = col->normal;
+            c.depth  = col->depths[j];
+            c.share  = 1.0f / col->num_points;
+
+            vec2 a_pos = { .x = world->state.x[c.a], .y = world->state.y[c.a] };
+            vec_sub(&col->points[j], &a_pos, &c.ra);
+
+            float e = world->restitution[c.a];
+
+            if (c.b >= 0) {
+                vec2 b_pos = { .x = world->state.x[c.b],
+                               .y = world->state.y[c.b] };
+                vec_sub(&col->points[j], &b_pos, &c.rb);
+
+                e = min(e, world->restitution[c.b]);
+            }
+
+            vec2 t;
+            vec_perp(&c.normal, &t);
+
+            c.mass_n = effectiveMass(world, &c, &c.normal);
+            c.mass_t = effectiveMass(world, &c, &t);
+
+            if (c.mass_n <= 0.0f)
                 continue;
+
+            // Bodies that hit each other hard enough bounce.
+            vec2  v  = contactVelocity(world, &c);
+            float vn = vec_dot(&v, &c.normal);
+
+            if (vn < -RestitutionThreshold)
+                c.bias = -e*vn;
+
+            contactT* match = (num_prev > 0) ? bsearch(&c, prev, num_prev,
+                                                       sizeof(contactT),
+                                                       compareContacts)
+                                             : NULL;
+
+            // Impulses from bounces shouldn't carry over, or bodies that are
+            // still overlapping after bouncing would keep getting pushed.
+            if (match && match->bias == 0.0f && c.bias == 0.0f) {
+                c.pn = match->pn;
+                c.pt = match->pt;
+                applyContactImpulse(world, &c, c.pn, c.pt);
             }
 
-            //memset(&c, 0, sizeof(collisionT));
-            c = findBodyBodyCollision(world, body, other_body);
-            if (c.exists)
-                arrayAdd(world->collisions, &c);
+            arrayAdd(world->contacts, &c);
+        }
+    }
+}
+
+static void solveContacts(worldT* world) {
+    // Sequential impulses: we go over the contacts a fixed number of times,
+    // each time correcting the velocity at one contact point. The impulses
+    // are accumulated over all iterations and clamped, rather than clamping
+    // each correction, so that later iterations can take back some of what
+    // was applied earlier. This is what makes stacks and clusters of bodies
+    // settle.
+    //     See Erin Catto's "Iterative Dynamics with Temporal Coherence" and
+    // Box2D-Lite for more information.
+
+    int num_contacts = arrayLength(world->contacts);
+    if (num_contacts == 0)
+        return;
+
+    contactT* contacts = arrayGet(world->contacts, 0);
+
+    for (int k = 0; k < ContactIterations; k++) {
+        for (int i = 0; i < num_contacts; i++) {
+            contactT* c = &contacts[i];
+
+            // Normal impulse: push the bodies apart, never pull.
+            vec2  v  = contactVelocity(world, c);
+            float dn = c->mass_n * (c->bias - vec_dot(&v, &c->normal));
+            float pn = max(c->pn + dn, 0.0f);
+
+            applyContactImpulse(world, c, pn - c->pn, 0.0f);
+            c->pn = pn;
+
+            // Friction impulse: limited by the normal impulse.
+            vec2 t;
+            vec_perp(&c->normal, &t);
+
+            v = contactVelocity(world, c);
 
-            other_body = other_body->next;
+            float limit = Friction * c->pn;
+            float dp    = -c->mass_t * vec_dot(&v, &t);
+            float pt    = clamp(c->pt + dp, -limit, limit);
+
+            applyContactImpulse(world, c, 0.0f, pt - c->pt);
+            c->pt = pt;
+        }
+    }
+}
+
+static void copyStates(bodyStatesT* dst, const bodyStatesT* src, int n) {
+    size_t size = n * sizeof(float);
+
+    memcpy(dst->x , src->x , size);
+    memcpy(dst->y , src->y , size);
+    memcpy(dst->o , src->o , size);
+    memcpy(dst->vx, src->vx, size);
+    memcpy(dst->vy, src->vy, size);
+    memcpy(dst->w , src->w , size);
+}
+
+static void integrateBodiesJob(void* data, int begin, int end) {
+    // Integrates bodies from their previous state, dt seconds forward. Most
+    // bodies have no forces acting on them, so we move everything in a
+    // straight line, in one batch per state variable. The bodies that do have
+    // forces acting on them are redone by integrateForcesJob() afterwards.
+    const stepJobT* job   = data;
+    worldT*         world = job->world;
+    bodyStatesT*    prev  = &world->prev_state;
+    bodyStatesT*    state = &world->state;
+    int             n     = end - begin;
+    float           dt    = job->dt;
+
+    // The accumulated forces give the bodies a kick before they move, which
+    // makes this symplectic Euler as far as they're concerned. That keeps
+    // orbits around force fields stable. Forces only last for one step.
+    // Sleeping bodies stay where they are.
+    for (int i = begin; i < end; i++) {
+        if (world->awake[i]) {
+            prev->vx[i] += world->ax[i]*dt;
+            prev->vy[i] += world->ay[i]*dt;
+            prev->w [i] += world->t [i]*world->inv_inertia[i]*dt;
         }
 
-        body = body->next;
+        world->ax[i] = 0.0f;
+        world->ay[i] = 0.0f;
+        world->t [i] = 0.0f;
     }
 
-    return arrayLength(world->collisions);
+    linearIntegrateBatch(&state->x[begin], &prev->x[begin], &prev->vx[begin],
+                         n, dt);
+    linearIntegrateBatch(&state->y[begin], &prev->y[begin], &prev->vy[begin],
+                         n, dt);
+    linearIntegrateBatch(&state->o[begin], &prev->o[begin], &prev->w [begin],
+                         n, dt);
+
+    size_t size = n * sizeof(float);
+    memcpy(&state->vx[begin], &prev->vx[begin], size);
+    memcpy(&state->vy[begin], &prev->vy[begin], size);
+    memcpy(&state->w [begin], &prev->w [begin], size);
 }
 
-static void resolveCollisions(worldT* world) {
-    for (int i = 0; i < arrayLength(world->collisions); i++) {
-        collisionT* c = arrayGet(world->collisions, i);
+static void integrateForcesJob(void* data, int begin, int end) {
+    // Integrates the bodies in [begin, end) of the force body list. The range
+    // may span several force models, but each model gets one call with all of
+    // its bodies in the range.
+    const stepJobT* job   = data;
+    worldT*         world = job->world;
+    const int*      ofs   = world->force_offsets;
 
-        vec2 v = c->a->state.v;
-        v.x += -c->contact.y * c->a->state.w;
-        v.y +=  c->contact.x * c->a->state.w;
+    for (int m = BallisticModel+1; m < NumForceModels; m++) {
+        int b = max(begin, ofs[m  ]);
+        int e = min(end  , ofs[m+1]);
 
-        vec_perp (&c->contact       , &v);
-        vec_scale(&v, c->a->state.w, &v);
-        vec_add  (&v, &c->a->state.v, &v);
+        if (b < e)
+            integrateForces(world, m, &world->force_bodies[b], e-b, job->dt);
+    }
+}
 
-        float inv_mass    = c->a->inv_mass;
-        float inv_inertia = powf(vec_perp_dot(&c->contact, &c->normal), 2.0f);
+static void applyForceFieldsJob(void* data, int begin, int end) {
+    const stepJobT* job = data;
+    applyForceFields(job->world, begin, end);
+}
 
-        float j  = -(1.0f + c->a->restitution)*vec_dot(&v, &c->normal);
-              j /= inv_mass + inv_inertia*c->a->inv_inertia;
+static void applyFields(worldT* world) {
+    if (!prepareForceFields(world))
+        return;
 
-        vec2 impulse = (vec2) { j*c->normal.x, j*c->normal.y };
-        //printf("before coll %4.2f %4.2f\n", c->a->state.v.x, c->a->state.v.y);
-        bodyApplyImpulse(c->a, impulse, c->contact);
-        //printf("after coll %4.2f %4.2f\n", c->a->state.v.x, c->a->state.v.y);
+    stepJobT job = { 0 };
+    parallelFor(world, applyForceFieldsJob, &job, world->num_bodies);
+}
+
+static void groupForceBodies(worldT* world) {
+    // Sorts the awake bodies that have forces acting on them by force model.
+    // Sleeping bodies have no velocity and are skipped, so the batch moves
+    // them nowhere. Ballistic bodies are done by the batch and not listed.
+    int* ofs = world->force_offsets;
+    int  pos[NumForceModels+1] = { 0 };
+
+    for (int i = 0; i < world->num_bodies; i++) {
+        if (world->awake[i] && world->force_models[i] != BallisticModel)
+            pos[world->force_models[i]+1]++;
     }
 
+    for (int m = 0; m < NumForceModels; m++)
+        pos[m+1] += pos[m];
+
+    memcpy(ofs, pos, sizeof(pos));
+
+    for (int i = 0; i < world->num_bodies; i++) {
+        if (world->awake[i] && world->force_models[i] != BallisticModel)
+            world->force_bodies[pos[world->force_models[i]]++] = i;
+    }
 }
 
-void worldStep(worldT* world, float dt) {
-    bodyT* body = world->bodies;
-    while (body) {
-        body->prev_state = body->state;
-        body = body->next;
+static void integrateBodies(worldT* world, float dt) {
+    stepJobT job = { .dt = dt };
+    parallelFor(world, integrateBodiesJob, &job, world->num_bodies);
+
+    groupForceBodies(world);
+
+    int num_force_bodies = world->force_offsets[NumForceModels];
+    parallelFor(world, integrateForcesJob, &job, num_force_bodies);
+}
+
+static void sweepBody(const worldT* world, int body, float t, float dt,
+                      float* s)
+{
+    // Finds the state of the body at time t (as a fraction of the step) along
+    // its current path, without touching the world.
+    const bodyStatesT* prev = &world->prev_state;
+
+    float h = (t - world->alpha[body]) * dt;
+
+    loadBodyState(prev, body, s);
+    integrateBodyForces(world, body, s, h);
+}
+
+static void advanceBody(worldT* world, int body, float t, float dt) {
+    // Moves a single body to time t along its current path.
+    float s[6];
+
+    sweepBody(world, body, t, dt, s);
+    storeBodyState(&world->state, body, s);
+}
+
+static void stopBody(worldT* world, int body, float t) {
+    // Makes the current state of the body its previous state, at time t.
+    float s[6];
+
+    loadBodyState(&world->state, body, s);
+    storeBodyState(&world->prev_state, body, s);
+
+    world->alpha[body] = t;
+}
+
+static float bodyRadius(const worldT* world, int body) {
+    // The distance from the body center to its furthest shape point can't be
+    // larger than the distance to the furthest corner of the shape AABB.
+    float x = fabsf(world->cx[body]) + world->hx[body];
+    float y = fabsf(world->cy[body]) + world->hy[body];
+
+    return (sqrtf(x*x + y*y));
+}
+
+static float bodyMaxSpeed(const worldT* world, int body) {
+    // An upper bound of how fast any point of the body moves during the rest
+    // of the step. We look at the velocities at both ends of the path, which
+    // is exact for ballistic bodies and good enough for the others.
+    const bodyStatesT* prev  = &world->prev_state;
+    const bodyStatesT* state = &world->state;
+
+    float v0 = sqrtf(prev->vx[body]*prev->vx[body]
+                   + prev->vy[body]*prev->vy[body]);
+    float v1 = sqrtf(state->vx[body]*state->vx[body]
+                   + state->vy[body]*state->vy[body]);
+    float w  = max(fabsf(prev->w[body]), fabsf(state->w[body]));
+
+    return (max(v0, v1) + w*bodyRadius(world, body));
+}
+
+static float findSeparation(const worldT* world, int a, const float* a_state,
+                            int b, const float* b_state)
+{
+    // Returns a lower bound of the distance between the two bodies, or between
+    // body a and the world bounds if b is -1. Negative if they are overlapping.
+    // The bodies are placed according to the specified states.
+
+    vec2 a_points[ShapeMaxPoints], a_normals[ShapeMaxPoints];
+
+    const shapeT* a_shape = world->bodies[a]->shape;
+    int           a_n     = a_shape->num_points;
+
+    transformShape(a_shape, a_state[0], a_state[1], a_state[2], a_points,
+                   a_normals);
+
+    if (b < 0) {
+        const aabbT* bounds = &world->bounds;
+        float        sep    = FLT_MAX;
+
+        for (int i = 0; i < a_n; i++) {
+            sep = min(sep, min(a_points[i].x - bounds->min.x,
+                               bounds->max.x - a_points[i].x));
+            sep = min(sep, min(a_points[i].y - bounds->min.y,
+                               bounds->max.y - a_points[i].y));
+        }
+
+        return (sep);
+    }
+
+    vec2 b_points[ShapeMaxPoints], b_normals[ShapeMaxPoints];
+
+    const shapeT* b_shape = world->bodies[b]->shape;
+    int           b_n     = b_shape->num_points;
+
+    transformShape(b_shape, b_state[0], b_state[1], b_state[2], b_points,
+                   b_normals);
+
+    // For convex polygons, the gap along the best separating axis is never
+    // larger than the actual distance between them.
+    int edge;
+    float a_sep = findMaxSeparation(a_points, a_normals, a_n, b_points, b_n,
+                                    FLT_MAX, &edge);
+    float b_sep = findMaxSeparation(b_points, b_normals, b_n, a_points, a_n,
+                                    FLT_MAX, &edge);
+
+    return (max(a_sep, b_sep));
+}
+
+static float findTimeOfImpact(const worldT* world, int a, int b, float dt) {
+    // Conservative advancement: no point of the bodies can close the gap
+    // between them faster than their max speeds combined, so we can safely
+    // move them forward by the time it would take to close the gap at that
+    // speed. We repeat until they are touching or the step is over.
+    //     See Brian Mirtich's thesis, "Impulse-based Dynamic Simulation of
+    // Rigid Body Systems", for more information.
+    //
+    // Returns the time of impact as a fraction of the step, or 1 if the bodies
+    // don't hit each other before the end of the step. Bodies that are
+    // already touching when we start don't count as an impact: the discrete
+    // collision pass at the end of the step takes care of them. The world is
+    // not changed, so any number of these can run at the same time.
+
+    float t     = world->alpha[a];
+    float speed = bodyMaxSpeed(world, a);
+
+    if (b >= 0) {
+        t      = max(t, world->alpha[b]);
+        speed += bodyMaxSpeed(world, b);
     }
 
-    int a = 1;
-    int b = 1;
+    float a_state[6], b_state[6];
+
+    for (int i = 0; i < MaxToiIterations; i++) {
+        sweepBody(world, a, t, dt, a_state);
+        if (b >= 0)
+            sweepBody(world, b, t, dt, b_state);
+
+        float sep = findSeparation(world, a, a_state, b, b_state);
 
-    // Don't test against zero because of rounding errors!
-    while (dt > (1.0/1000000.0f)) {
-        float x = (float)a/(float)b;
+        if (sep < ToiTarget+ToiTolerance)
+            return ((i > 0) ? t : 1.0f);
 
-        body = world->bodies;
-        while (body) {
-            body->state = body->prev_state;
+        if (speed*dt <= 0.0f)
+            break;
 
-            bodyStateT* s = &body->state;
-            IntegrateFn(&s->x, &s->v, 6, dt*x, body->deriv_fn);
+        t += (sep - ToiTarget) / (speed*dt);
 
-            body = body->next;
+        if (t >= 1.0f)
+            break;
+
+        // We ran out of iterations before the bodies touched. We haven't moved
+        // past the impact, so we stop here and pick up from t later.
+        if (i == MaxToiIterations-1)
+            return (t);
+    }
+
+    return (1.0f);
+}
+
+static void findImpactsJob(void* data, int begin, int end) {
+    const stepJobT* job     = data;
+    const worldT*   world   = job->world;
+    impactT*        impacts = arrayGet(world->impacts, 0);
+
+    for (int i = begin; i < end; i++)
+        impacts[i].t = findTimeOfImpact(world, impacts[i].a, impacts[i].b,
+                                        job->dt);
+}
+
+static void findImpacts(worldT* world, float dt) {
+    arrayT* impacts = world->impacts;
+    arrayClear(impacts);
+
+    const bool* awake = world->awake;
+    const bool* ccd   = world->ccd;
+
+    // Only bodies with continuous collision detection are swept, so those are
+    // the only ones we look for impacts for. They can only hit the world
+    // bounds if their swept AABBs reach them.
+    if (world->bounds_mode == SolidBounds) {
+        float margin = ToiTarget + ToiTolerance;
+
+        for (int i = 0; i < world->num_bodies; i++) {
+            if (!awake[i] || !ccd[i])
+                continue;
+
+            if (aabbContains(&world->bounds, &world->aabbs[i], margin))
+                continue;
+
+            impactT impact = { i, -1, 1.0f };
+            arrayAdd(impacts, &impact);
         }
+    }
 
-        if (findCollisions(world) > 0) {
-            // Collisions were found, so we double the value of b. If we've
-            // reached the max value for b, we try to resolve them. Otherwise,
-            // we go back and try to simulate half the time we did last
-            // iteration.
-            if ((b<<=1) == (1<<MaxSubdivs)) {
-                resolveCollisions(world);
-
-                body = world->bodies;
-                while (body) {
-                    body->prev_state.v = body->state.v;
-                    body->prev_state.w = body->state.w;
-
-                    body = body->next;
-                }
-
-                // Reset a and b to make sure we simulate the remainder of dt
-                // with our next attempt.
-                a = b = 1;
-            }
+    int num_pairs = arrayLength(world->pairs);
+    for (int i = 0; i < num_pairs; i++) {
+        bodyPairT* pair = arrayGet(world->pairs, i);
+
+        // Sleeping bodies don't move, so they can't hit each other.
+        if (!awake[pair->a] && !awake[pair->b])
+            continue;
+
+        if (!ccd[pair->a] && !ccd[pair->b])
+            continue;
+
+        impactT impact = { pair->a, pair->b, 1.0f };
+        arrayAdd(impacts, &impact);
+    }
+
+    stepJobT job = { .dt = dt };
+    parallelFor(world, findImpactsJob, &job, arrayLength(impacts));
+}
+
+static void resolveImpacts(worldT* world, float dt) {
+    // We handle the impacts in order. Only the two bodies involved are moved
+    // back to their time of impact and sent off along their new paths; the
+    // rest of the world isn't touched. Afterwards, we only need to look again
+    // at impacts involving those two bodies.
+    arrayT* impacts     = world->impacts;
+    int     num_impacts = arrayLength(impacts);
+
+    for (int k = 0; k < MaxImpacts; k++) {
+        impactT* first = NULL;
+
+        for (int i = 0; i < num_impacts; i++) {
+            impactT* impact = arrayGet(impacts, i);
+
+            if (impact->t < 1.0f && (!first || impact->t < first->t))
+                first = impact;
         }
-        else {
-            body = world->bodies;
-            while (body) {
-                body->prev_state = body->state;
-                body = body->next;
+
+        if (!first)
+            break;
+
+        int   a = first->a;
+        int   b = first->b;
+        float t = first->t;
+
+        advanceBody(world, a, t, dt);
+        if (b >= 0)
+            advanceBody(world, b, t, dt);
+
+        // The bodies are ToiTarget apart now, so we need a bit of margin to
+        // find the contact.
+        float      margin = 2.0f*ToiTarget;
+        collisionT c;
+
+        if (b < 0) c = findBodyWorldCollision(world, a, margin);
+        else       c = findBodyBodyCollision (world, a, b, margin);
+
+        if (c.exists)
+            resolveCollision(world, &c);
+
+        stopBody(world, a, t);
+        advanceBody(world, a, 1.0f, dt);
+
+        if (b >= 0) {
+            stopBody(world, b, t);
+            advanceBody(world, b, 1.0f, dt);
+        }
+
+        for (int i = 0; i < num_impacts; i++) {
+            impactT* impact = arrayGet(impacts, i);
+
+            if (impact->a == a || impact->b == a
+             || (b >= 0 && (impact->a == b || impact->b == b)))
+            {
+                impact->t = findTimeOfImpact(world, impact->a, impact->b, dt);
             }
+        }
+    }
+}
+
+static int findIsland(int* island, int body) {
+    // Union-find with path halving.
+    while (island[body] != body) {
+        island[body] = island[island[body]];
+        body         = island[body];
+    }
+
+    return (body);
+}
 
-            dt -= x*dt;
-            a <<= 1;
+static void updateSleep(worldT* world, float dt) {
+    // Bodies that touch each other are joined into islands, and an island is
+    // only put to sleep once all of its bodies have been resting for long
+    // enough. Otherwise a body could fall asleep while something is still
+    // pushing it. We join bodies whose swept AABBs overlap, which may join a
+    // few bodies that aren't actually touching, but that only keeps them
+    // awake a little longer.
+
+    const bodyStatesT* s     = &world->state;
+    bool*              awake = world->awake;
+    int*               island       = world->island;
+    bool*              island_awake = world->island_awake;
+    int                n            = world->num_bodies;
+
+    for (int i = 0; i < n; i++) {
+        island      [i] = i;
+        island_awake[i] = false;
+    }
+
+    int num_pairs = arrayLength(world->pairs);
+    for (int i = 0; i < num_pairs; i++) {
+        bodyPairT* pair = arrayGet(world->pairs, i);
+
+        // Static bodies don't join islands, or everything resting on the same
+        // static body would have to fall asleep at the same time.
+        if (!awake[pair->a] || !awake[pair->b])
+            continue;
+
+        int a = findIsland(island, pair->a);
+        int b = findIsland(island, pair->b);
+
+        if (a != b)
+            island[max(a, b)] = min(a, b);
+    }
+
+    const float lin_tol = LinearSleepTolerance*LinearSleepTolerance;
+    const float ang_tol = AngularSleepTolerance;
+
+    for (int i = 0; i < n; i++) {
+        if (!awake[i])
+            continue;
+
+        float v2 = s->vx[i]*s->vx[i] + s->vy[i]*s->vy[i];
+
+        if (v2 > lin_tol || fabsf(s->w[i]) > ang_tol)
+            world->sleep_time[i]  = 0.0f;
+        else
+            world->sleep_time[i] += dt;
+
+        if (world->sleep_time[i] < TimeToSleep)
+            island_awake[findIsland(island, i)] = true;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (!awake[i] || island_awake[findIsland(island, i)])
+            continue;
+
+        awake[i] = false;
+
+        world->state.vx[i] = world->prev_state.vx[i] = 0.0f;
+        world->state.vy[i] = world->prev_state.vy[i] = 0.0f;
+        world->state.w [i] = world->prev_state.w [i] = 0.0f;
+    }
+}
+
+static void correctPositions(worldT* world) {
+    // We push overlapping bodies apart by moving them directly, instead of
+    // adding velocity to the contact solver. That way, bodies that start out
+    // overlapping don't fly apart with more energy than they came in with.
+    // The push is applied at the contact points so that it corrects rotation
+    // too, and split between the points of each collision.
+
+    int num_contacts = arrayLength(world->contacts);
+
+    for (int i = 0; i < num_contacts; i++) {
+        contactT* c = arrayGet(world->contacts, i);
+
+        float d = min(BiasFactor*(c->depth - LinearSlop), MaxCorrection);
+        if (d <= 0.0f)
+            continue;
+
+        vec2 p;
+        vec_scale(&c->normal, d * c->mass_n * c->share, &p);
+
+        int a = c->a;
+        world->state.x[a] += p.x * world->inv_mass[a];
+        world->state.y[a] += p.y * world->inv_mass[a];
+        world->state.o[a] += vec_perp_dot(&c->ra, &p) * world->inv_inertia[a];
+
+        int b = c->b;
+        if (b >= 0) {
+            world->state.x[b] -= p.x * world->inv_mass[b];
+            world->state.y[b] -= p.y * world->inv_mass[b];
+            world->state.o[b] -= vec_perp_dot(&c->rb, &p)
+                               * world->inv_inertia[b];
         }
     }
 }
+
+static void wrapBodies(worldT* world) {
+    // Bodies whose centers have left the world bounds are moved to the
+    // opposite side. The previous and start states are moved along with the
+    // current one so that the path through the step stays in one piece.
+    if (world->bounds_mode != WrapBounds)
+        return;
+
+    const aabbT* bounds = &world->bounds;
+
+    float w = bounds->max.x - bounds->min.x;
+    float h = bounds->max.y - bounds->min.y;
+
+    bodyStatesT* state = &world->state;
+    bodyStatesT* prev  = &world->prev_state;
+
+    for (int i = 0; i < world->num_bodies; i++) {
+        if (!world->awake[i])
+            continue;
+
+        float dx = 0.0f, dy = 0.0f;
+
+        if      (state->x[i] <  bounds->min.x) dx =  w;
+        else if (state->x[i] >= bounds->max.x) dx = -w;
+
+        if      (state->y[i] <  bounds->min.y) dy =  h;
+        else if (state->y[i] >= bounds->max.y) dy = -h;
+
+        state->x[i] += dx; prev->x[i] += dx; world->start_x[i] += dx;
+        state->y[i] += dy; prev->y[i] += dy; world->start_y[i] += dy;
+    }
+}
+
+static void updateProxies(worldT* world) {
+    // Sleeping and static bodies haven't moved, and most awake bodies are
+    // still inside their enlarged tree AABBs, so this is mostly tests.
+    for (int i = 0; i < world->num_bodies; i++) {
+        if (world->awake[i])
+            worldMoveProxy(world, i);
+    }
+}
+
+void worldStep(worldT* world, float dt) {
+    int n = world->num_bodies;
+
+    copyStates(&world->prev_state, &world->state, n);
+    memset(world->alpha, 0, n * sizeof(float));
+
+    memcpy(world->start_x, world->state.x, n * sizeof(float));
+    memcpy(world->start_y, world->state.y, n * sizeof(float));
+    memcpy(world->start_o, world->state.o, n * sizeof(float));
+
+    applyFields    (world);
+    integrateBodies(world, dt);
+
+    // Find the pairs that might collide at some point during the step.
+    updateAABBs(world, &world->prev_state, false);
+    updateAABBs(world, &world->state     , true );
+    findPairs(world);
+
+    findImpacts   (world, dt);
+    resolveImpacts(world, dt);
+
+    // Bodies that were already touching, or impacts we didn't have time for,
+    // are resolved at the end of the step.
+    findCollisions  (world);
+    prepareContacts (world);
+    solveContacts   (world);
+    correctPositions(world);
+
+    wrapBodies   (world);
+    updateProxies(world);
+    updateSleep  (world, dt);
+}
+
+void worldGetStats(const worldT* world, worldStatsT* stats) {
+    int num_awake = 0;
+    for (int i = 0; i < world->num_bodies; i++) {
+        if (world->awake[i])
+            num_awake++;
+    }
+
+    stats->num_bodies     = world->num_bodies;
+    stats->num_awake      = num_awake;
+    stats->num_pairs      = arrayLength(world->pairs);
+    stats->num_collisions = arrayLength(world->collisions);
+    stats->num_contacts   = arrayLength(world->contacts);
+}
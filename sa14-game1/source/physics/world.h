@@ -7,8 +7,45 @@
 
 #include "base/array.h"
 #include "base/common.h"
+#include "base/jobs.h"
+#include "math/aabb.h"
+#include "math/vector.h"
 #include "physics/physics.h"
 
+#include <stddef.h> // size_t
+#include <stdint.h>
+
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef enum {
+    SpatialHashBroadphase,  // Rebuilt from scratch every collision pass.
+    SweepAndPruneBroadphase // Incremental, best for temporally coherent scenes.
+} broadphaseT;
+
+typedef enum {
+    SolidBounds, // Bodies bounce off the world bounds.
+    WrapBounds   // Bodies leaving one side come back in on the opposite side.
+} boundsModeT;
+
+// Counters from the last call to worldStep(), for profiling.
+typedef struct {
+    int num_bodies;
+    int num_awake;      // Bodies that are neither sleeping nor static.
+    int num_pairs;      // Pairs found by the broad-phase.
+    int num_collisions; // Pairs that were touching at the end of the step.
+    int num_contacts;   // Contact points handed to the contact solver.
+} worldStatsT;
+
+// What a ray cast with worldRaycast() hit first.
+typedef struct {
+    bodyT* body;
+    vec2   point;    // Where the ray hit the body shape.
+    vec2   normal;   // The normal of the shape edge that was hit.
+    float  distance; // From the ray origin to the point.
+} rayHitT;
+
 /*------------------------------------------------
  * FUNCTIONS
  *----------------------------------------------*/
@@ -18,7 +55,69 @@ void worldInit(worldT* world);
 worldT* worldNew(void);
 void worldFree(worldT* world);
 void worldAddBody(worldT* world, bodyT* body);
+
+// Removes a body from the world. The body keeps its state, so it can be added
+// to a world again.
+void worldRemoveBody(worldT* world, bodyT* body);
+void worldSetBroadphase(worldT* world, broadphaseT broadphase);
+
+// Sets the area that bodies are kept inside. Defaults to solid bounds from
+// (-7, -5) to (7, 5). With wrapping bounds, bodies don't collide across the
+// edges, only their positions wrap around.
+void worldSetBounds(worldT* world, aabbT bounds, boundsModeT mode);
+aabbT worldBounds(const worldT* world);
+
+// Lets the world spread the work in worldStep() over the threads of the
+// specified job system. The results are the same as without one. Pass NULL to
+// go back to a single thread. The world does not take ownership.
+void worldSetJobSystem(worldT* world, jobSystemT* jobs);
 void worldStep(worldT* world, float dt);
+void worldGetStats(const worldT* world, worldStatsT* stats);
+
+// Snapshots hold the state of all bodies in the world (positions, velocities,
+// accumulated forces and sleep state) and the contact impulses used for warm
+// starting, in a single buffer provided by the caller. Stepping the world
+// after restoring a snapshot gives bit-identical results every time. Body
+// properties like mass are not included, and a snapshot can only be restored
+// into the world it was taken from, with the same bodies in it.
+size_t worldSnapshotSize(const worldT* world);
+
+// Returns the number of bytes written, or zero if buf_size is too small.
+size_t worldSnapshot(const worldT* world, void* buf, size_t buf_size);
+
+// Returns false, leaving the world untouched, if the buffer doesn't hold a
+// snapshot of this world.
+bool worldRestore(worldT* world, const void* buf, size_t size);
+
+// Returns a hash of the same state that goes into a snapshot. Two worlds that
+// are in lockstep have the same hash.
+uint32_t worldStateHash(const worldT* world);
+
+// The query functions below go through a dynamic AABB tree over the bodies,
+// so they only look at the bodies near the query. Bodies are found where they
+// were at the end of the last step, or where they were last moved to.
+
+// Adds the bodies whose AABBs overlap the specified one to an array (of
+// bodyT*).
+void worldQueryAABB(const worldT* world, aabbT aabb, arrayT* bodies);
+
+// Adds the bodies whose shapes are within radius of the center to an array
+// (of bodyT*).
+void worldQueryRadius(const worldT* world, vec2 center, float radius,
+                      arrayT* bodies);
+
+// Casts a ray from the origin in the specified direction (which doesn't need
+// to be normalized) and finds the first body shape it hits within max_dist.
+// Bodies that the ray starts inside of are not hit. Returns false if nothing
+// was hit.
+bool worldRaycast(const worldT* world, vec2 origin, vec2 dir, float max_dist,
+                  rayHitT* hit);
+
+// Returns the body whose shape is nearest to p, other than ignore (which can
+// be NULL), or NULL if there is no body within max_dist. Bodies that contain
+// p are at zero distance.
+bodyT* worldNearest(const worldT* world, vec2 p, float max_dist,
+                    const bodyT* ignore);
 
 bool areBodiesColliding(bodyT* a, bodyT* b);
 
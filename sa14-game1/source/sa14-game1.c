@@ -20,6 +20,8 @@
 #include "base/pak.h"
 #include "base/time.h"
 #include "engine/game.h"
+#include "entities/asteroidentity.h"
+#include "entities/playerentity.h"
 #include "graphics/graphics.h"
 #include "graphics/shader.h"
 #include "graphics/texture.h"
@@ -31,6 +33,15 @@
 #include <windows.h>
 #endif
 
+/*------------------------------------------------
+ * CONSTANTS
+ *----------------------------------------------*/
+
+// Asteroids are spawned one at a time, this many seconds apart, until there
+// are MaxAsteroids of them.
+#define SpawnInterval 0.5f
+#define MaxAsteroids  20
+
 /*------------------------------------------------
  * FUNCTIONS
  *----------------------------------------------*/
@@ -108,33 +119,19 @@ static void showSplashScreen(const textureT* splash_tex, float secs) {
     useShader   (NULL);
 }
 
-// ugly crap, fix this
-static arrayT* prealloc;
-static int spawn_count;
-static float lol;
+static int   spawn_count;
+static float spawn_time;
 
 void frameFunc(float dt) {
-    if (!prealloc) {
-        prealloc = arrayNew(sizeof(gameEntityT*));
-        for (int i = 0; i < 20; i++) {
-            gameEntityT* e = newAsteroidEntity();
-            arrayAdd(prealloc, &e);
-        }
-    }
-
-    //if (lol < 0)
-    //    return;
-    lol += dt;
-    while (lol >= 0.5f) {
-        //addEntityToGame(newAsteroidEntity());
-        if (spawn_count < 20) {
-            gameEntityT* e = *(gameEntityT**)arrayGet(prealloc, spawn_count);
-            addEntityToGame(e);
+    // Entities come from pools, so spawning them as we go is cheap.
+    spawn_time += dt;
+    while (spawn_time >= SpawnInterval) {
+        if (spawn_count < MaxAsteroids) {
+            addEntityToGame(newAsteroidEntity());
             spawn_count++;
         }
-        lol -= 0.5f;
-        //lol = -1;
-        //break;
+
+        spawn_time -= SpawnInterval;
     }
 }
 
@@ -167,6 +164,9 @@ int main(void) {
     addSubsystemToGame(newPhysicsSubsystem());
     addSubsystemToGame(newGraphicsSubsystem());
 
+    // Asteroids are spawned by frameFunc(), so their mesh is loaded up front.
+    loadAsteroidResources();
+
     gameEntityT* player_entity = newPlayerEntity();
     addEntityToGame(player_entity);
 
@@ -10,6 +10,7 @@
 
 #include "graphicssubsystem.h"
 
+#include "base/array.h"
 #include "base/common.h"
 #include "components/graphicscomponent.h"
 #include "components/physicscomponent.h"
@@ -23,6 +24,7 @@
 #include "graphics/texture.h"
 #include "math/matrix.h"
 #include "math/vector.h"
+#include "subsystems/physicssubsystem.h"
 
 #include <stdlib.h>
 
@@ -32,6 +34,17 @@
  * TYPES
  *----------------------------------------------*/
 
+// Everything needed to draw a component, copied out of it at the end of the
+// simulation frame so that drawing never touches the components themselves.
+typedef struct {
+    triMeshT*  mesh;
+    materialT* material;
+
+    mat4x4 transform;
+    mat4x4 model_view_proj;
+    mat4x4 prev_model_view_proj;
+} drawItemT;
+
 typedef struct {
     vec3 clear_color;
     float aspect_ratio;
@@ -55,13 +68,19 @@ typedef struct {
     renderTargetT* mblur_rt;
 
     mat4x4 view_proj;
+
+    // Two buffers of draw items, so that one can be drawn while the next one
+    // is being filled in (see gameSetPipelined()).
+    arrayT* draw_items[2];
+
+    int physics_id; // Subsystem id of the physics components.
 } graphicsSubsystemDataT;
 
 /*------------------------------------------------
  * FUNCTIONS
  *----------------------------------------------*/
 
-static void drawComponents(gameSubsystemT* subsystem, bool use_materials);
+static void drawItems(gameSubsystemT* subsystem, int buffer, bool use_materials);
 
 #ifdef DRAW_TRI_NORMALS
 static void loadNormalShader(graphicsSubsystemDataT* gfx_data) {
@@ -88,7 +107,7 @@ static void initPostFX(graphicsSubsystemDataT* gfx_data) {
 
 bool postit = false;
 int frame_counter;
-static void applyPostFX(gameSubsystemT* subsystem) {
+static void applyPostFX(gameSubsystemT* subsystem, int buffer) {
     graphicsSubsystemDataT* gfx_data = subsystem->data;
 
     frame_counter--;
@@ -113,7 +132,7 @@ static void applyPostFX(gameSubsystemT* subsystem) {
     renderTargetT* old_rt = useRenderTarget(gfx_data->mblur_rt);
     useShader      (gfx_data->mblur_shader0);
     clearDisplay   (0.0f, 0.0f, 0.0f);
-    drawComponents (subsystem, false);
+    drawItems      (subsystem, buffer, false);
     useRenderTarget(old_rt);
 
     // 2. Apply motion blur.
@@ -187,27 +206,48 @@ static void setupLights(graphicsSubsystemDataT* gfx_data) {
     setShaderParam("Lights[1].specular", &light_diffuse);
 }
 
-static void setupTransforms(gameSubsystemT* subsystem) {
+static void setupTransforms(gameSubsystemT* subsystem, arrayT* draw_items) {
     graphicsSubsystemDataT* gfx_data = subsystem->data;
 
-    for (int i = 0; i < arrayLength(subsystem->components); i++) {
-        gameComponentT* component = *(gameComponentT**)arrayGet(subsystem->components, i);
-        graphicsComponentDataT* gfx_component = component->data;
+    componentPoolT* components = subsystem->components;
 
-        gameComponentT* phys_c = getComponent(component->entity, "physics");
+    arrayClear(draw_items);
+
+    for (int i = 0; i < componentPoolLength(components); i++) {
+        gameComponentT*         component     = componentPoolComponent(components, i);
+        graphicsComponentDataT* gfx_component = componentPoolData(components, i);
+
+        gameComponentT* phys_c = getComponentById(component->entity, gfx_data->physics_id);
         // The graphics component needs a physics component to pull the position
         // from.
         assert(phys_c != NULL);
         physicsComponentDataT*  phys_component = phys_c->data;
+        bodyT*                  body           = phys_component->body;
+
+        // Physics runs at a fixed step, so we draw bodies in between their
+        // last two states. Otherwise they would stutter whenever the frame
+        // rate and the physics rate don't line up.
+        float alpha = physicsInterpolationAlpha(phys_c->subsystem);
+
+        vec2 prev_pos = bodyPrevPosition(body);
+        vec2 pos      = bodyPosition    (body);
+
+        vec_sub  (&pos, &prev_pos, &pos);
+        vec_scale(&pos, alpha    , &pos);
+        vec_add  (&pos, &prev_pos, &pos);
+
+        float prev_o = bodyPrevOrientation(body);
+        float o      = prev_o + (bodyOrientation(body) - prev_o)*alpha;
 
         mat4x4 model;
         mat_identity(&model);
 
-        mat4x4 translation;
-        vec2 pos = bodyPosition(phys_component->body);
+        mat4x4 rotation, translation;
+        mat_rot_z     (o, &rotation);
         mat_transl_xyz(pos.x, pos.y, 0.0f, &translation);
 
         mat_mul(&gfx_component->transform, &model, &model);
+        mat_mul(&rotation                , &model, &model);
         mat_mul(&translation             , &model, &model);
 
         gfx_component->prev_model_view_proj = gfx_component->model_view_proj;
@@ -216,64 +256,75 @@ static void setupTransforms(gameSubsystemT* subsystem) {
         mat_identity(mvp);
         mat_mul     (&model              , mvp, mvp);
         mat_mul     (&gfx_data->view_proj, mvp, mvp);
+
+        if (!gfx_component->mesh)
+            continue;
+
+        drawItemT item;
+
+        item.mesh                 = gfx_component->mesh;
+        item.material             = gfx_component->material;
+        item.transform            = gfx_component->transform;
+        item.model_view_proj      = gfx_component->model_view_proj;
+        item.prev_model_view_proj = gfx_component->prev_model_view_proj;
+
+        arrayAdd(draw_items, &item);
     }
 }
 
-static void drawComponent(graphicsSubsystemDataT* gfx_data, gameComponentT* component, bool use_material) {
-    graphicsComponentDataT* gfx_component  = component->data;
+static int compareMaterials(const void* a, const void* b) {
+    int a_sort = ((const drawItemT*)a)->material->sort_value;
+    int b_sort = ((const drawItemT*)b)->material->sort_value;
 
-    if (!gfx_component->mesh)
-        return;
+    return ((a_sort > b_sort) - (a_sort < b_sort));
+}
 
-    if (use_material) {
-        useMaterial(gfx_component->material);
-        setupLights(gfx_data);
-    }
+static void sortItemsByMaterial(arrayT* draw_items) {
+    int n = arrayLength(draw_items);
+
+    if (n > 1)
+        qsort(arrayGet(draw_items, 0), n, sizeof(drawItemT), compareMaterials);
+}
+
+static void takeSnapshot(gameSubsystemT* subsystem, int buffer) {
+    graphicsSubsystemDataT* gfx_data   = subsystem->data;
+    arrayT*                 draw_items = gfx_data->draw_items[buffer];
 
-    setShaderParam("ModelViewProj"    , &gfx_component->model_view_proj);
-    setShaderParam("PrevModelViewProj", &gfx_component->prev_model_view_proj);
-    setShaderParam("NormalMatrix"     , &gfx_component->transform);
+    setupCamera    (gfx_data);
+    setupTransforms(subsystem, draw_items);
 
-    drawMesh(gfx_component->mesh);
+    // Sorting the copies leaves the components where they are, so the
+    // simulation can keep running through them while we draw.
+    sortItemsByMaterial(draw_items);
 }
 
-static void sortComponentsByMaterial(gameSubsystemT* subsystem) {
-    for (int i = 0; i < arrayLength(subsystem->components); i++) {
-        for (int j = (i+1); j < arrayLength(subsystem->components); j++) {
-            gameComponentT** a_ptr = arrayGet(subsystem->components, i);
-            gameComponentT** b_ptr = arrayGet(subsystem->components, j);
-
-            graphicsComponentDataT* a = (*a_ptr)->data;
-            graphicsComponentDataT* b = (*b_ptr)->data;
-
-            if (a->material->sort_value > b->material->sort_value) {
-                gameComponentT* tmp = *a_ptr;
-                *a_ptr = *b_ptr;
-                *b_ptr = tmp;
-            }
-        }
+static void drawItem(graphicsSubsystemDataT* gfx_data, const drawItemT* item, bool use_material) {
+    if (use_material) {
+        useMaterial(item->material);
+        setupLights(gfx_data);
     }
+
+    setShaderParam("ModelViewProj"    , &item->model_view_proj);
+    setShaderParam("PrevModelViewProj", &item->prev_model_view_proj);
+    setShaderParam("NormalMatrix"     , &item->transform);
+
+    drawMesh(item->mesh);
 }
 
-static void drawComponents(gameSubsystemT* subsystem, bool use_materials) {
-    if (use_materials)
-        sortComponentsByMaterial(subsystem);
+static void drawItems(gameSubsystemT* subsystem, int buffer, bool use_materials) {
+    graphicsSubsystemDataT* gfx_data   = subsystem->data;
+    arrayT*                 draw_items = gfx_data->draw_items[buffer];
 
-    for (int i = 0; i < arrayLength(subsystem->components); i++) {
-        gameComponentT* component = *(gameComponentT**)arrayGet(subsystem->components, i);
-        drawComponent(subsystem->data, component, use_materials);
-    }
+    for (int i = 0; i < arrayLength(draw_items); i++)
+        drawItem(gfx_data, arrayGet(draw_items, i), use_materials);
 
     if (use_materials)
         useMaterial(NULL);
 }
 
-static void drawEverything(gameSubsystemT* subsystem, float dt) {
+static void drawEverything(gameSubsystemT* subsystem, int buffer, float dt) {
     graphicsSubsystemDataT* gfx_data = subsystem->data;
 
-    setupCamera(gfx_data);
-    setupTransforms(subsystem);
-
     useRenderTarget(gfx_data->render_target);
 
     vec3* clear_color = &gfx_data->clear_color;
@@ -287,25 +338,31 @@ static void drawEverything(gameSubsystemT* subsystem, float dt) {
     glDepthMask(depth_mask);
 
 
-    drawComponents(subsystem, true);
+    drawItems(subsystem, buffer, true);
 
 #ifdef DRAW_TRI_NORMALS
     useShader(gfx_data->normal_shader);
-
-    setupCamera   (gfx_data);
-    drawComponents(subsystem, false);
+    drawItems(subsystem, buffer, false);
 #endif // DRAW_TRI_NORMALS
 
     useRenderTarget(NULL);
     presentRenderTarget(gfx_data->render_target);
 
-    applyPostFX(subsystem);
+    applyPostFX(subsystem, buffer);
 
     drawText("SCORE: 12345\nNOOB WARNING: HIGH", 10.0f, 10.0f, "Sector 034", 10);
 }
 
+static void cleanupGraphics(gameSubsystemT* subsystem) {
+    graphicsSubsystemDataT* gfx_data = subsystem->data;
+
+    arrayFree(gfx_data->draw_items[0]);
+    arrayFree(gfx_data->draw_items[1]);
+    free(gfx_data);
+}
+
 gameSubsystemT* newGraphicsSubsystem(void) {
-    gameSubsystemT* subsystem = newSubsystem("graphics");
+    gameSubsystemT* subsystem = newSubsystem("graphics", sizeof(graphicsComponentDataT));
     graphicsSubsystemDataT* gfx_data = calloc(1, sizeof(graphicsSubsystemDataT));
 
     gfx_data->aspect_ratio   = screenWidth() / (float)screenHeight();
@@ -313,13 +370,22 @@ gameSubsystemT* newGraphicsSubsystem(void) {
     gfx_data->render_target  = createRenderTarget(screenWidth(), screenHeight());
     gfx_data->background_tex = gameResource("texture:background", ResTexture);
     gfx_data->screen_tex     = createTexture();
+    gfx_data->physics_id     = subsystemNameId("physics");
+    gfx_data->draw_items[0]  = arrayNew(sizeof(drawItemT));
+    gfx_data->draw_items[1]  = arrayNew(sizeof(drawItemT));
 
 #ifdef DRAW_TRI_NORMALS
     loadNormalShader(gfx_data);
 #endif // DRAW_TRI_NORMALS
 
     subsystem->data = gfx_data;
-    subsystem->after_update_fn = drawEverything;
+    subsystem->snapshot_fn = takeSnapshot;
+    subsystem->render_fn = drawEverything;
+    subsystem->cleanup_fn = cleanupGraphics;
+
+    // The component update functions only animate their own meshes.
+    subsystemWrites(subsystem, ComponentStage, "graphics");
+    subsystem->parallel_components = true;
 
     initPostFX(gfx_data);
 
@@ -4,6 +4,8 @@
 
 #include "physicssubsystem.h"
 
+#include "base/jobs.h"
+#include "base/time.h"
 #include "components/physicscomponent.h"
 #include "engine/game.h"
 #include "engine/subsystem.h"
@@ -12,21 +14,42 @@
 #include "math/matrix.h"
 #include "physics/physics.h"
 
+#include <math.h>
 #include <stdlib.h>
 
 /*------------------------------------------------
  * CONSTANTS
  *----------------------------------------------*/
 
+// The step size used in fixed mode, and the smallest one in adaptive mode.
 #define TimeStep (1.0f/120.0f)
 
+// The largest step size the adaptive mode goes up to.
+#define MaxTimeStep (1.0f/30.0f)
+
+// The max number of steps taken in a single frame. Time that doesn't fit is
+// dropped, so that a long frame doesn't make the next one even longer.
+#define MaxSubSteps 8
+
+// The largest share of real time that we want to spend in worldStep(). When
+// stepping gets more expensive than that (and the step size can't grow any
+// further), simulation time is slowed down instead.
+#define MaxPhysicsLoad 0.5f
+
+// How quickly the measured step cost follows changes, from 0 to 1.
+#define StepCostSmoothing 0.1f
+
 /*------------------------------------------------
  * TYPES
  *----------------------------------------------*/
 
 typedef struct {
     float time_frac;
+    float time_step;
+    bool  adaptive;
     worldT* world;
+
+    physicsStatsT stats;
 } physicsSubsystemDataT;
 
 /*------------------------------------------------
@@ -40,23 +63,135 @@ static void addBodyToWorld(gameSubsystemT* subsystem, gameComponentT* component)
     worldAddBody(phys_data->world, phys_component->body);
 }
 
+static void removeBodyFromWorld(gameSubsystemT* subsystem, gameComponentT* component) {
+    physicsComponentDataT* phys_component = component->data;
+    physicsSubsystemDataT* phys_data = subsystem->data;
+
+    worldRemoveBody(phys_data->world, phys_component->body);
+}
+
+static void adaptStepRate(physicsSubsystemDataT* phys_data) {
+    // The step cost hardly depends on the step size, so the load is inversely
+    // proportional to it. Doubling the step halves the load, and we only go
+    // back down when the load would still be well within budget, so that we
+    // don't flip back and forth between two step sizes.
+    physicsStatsT* stats = &phys_data->stats;
+    float          load  = stats->step_cost / phys_data->time_step;
+
+    if (phys_data->adaptive) {
+        if (load > MaxPhysicsLoad && phys_data->time_step < MaxTimeStep) {
+            phys_data->time_step *= 2.0f;
+            load                 *= 0.5f;
+        }
+        else if (load < MaxPhysicsLoad*0.125f
+              && phys_data->time_step > TimeStep)
+        {
+            phys_data->time_step *= 0.5f;
+            load                 *= 2.0f;
+        }
+    }
+
+    // If we still can't keep up, we slow down time rather than fall further
+    // and further behind.
+    stats->time_scale = (load > MaxPhysicsLoad) ? MaxPhysicsLoad/load : 1.0f;
+    stats->time_step  = phys_data->time_step;
+}
+
 static void stepWorld(gameSubsystemT* subsystem, float dt) {
     physicsSubsystemDataT* phys_data = subsystem->data;
+    physicsStatsT*         stats     = &phys_data->stats;
+    float                  step      = phys_data->time_step;
+
+    float sim_dt = dt * stats->time_scale;
+    stats->dropped_time += dt - sim_dt;
 
-    dt += phys_data->time_frac;
-    while (dt >= TimeStep) {
-        worldStep(phys_data->world, TimeStep);
-        dt -= TimeStep;
+    dt = phys_data->time_frac + sim_dt;
+
+    timeT time      = getTime();
+    int   num_steps = 0;
+
+    while (dt >= step && num_steps < MaxSubSteps) {
+        worldStep(phys_data->world, step);
+        dt -= step;
+        num_steps++;
     }
+
+    // Whatever didn't fit in the budget is dropped, apart from the part of a
+    // step that we would have carried over anyway.
+    if (dt >= step) {
+        float dropped = floorf(dt / step) * step;
+
+        dt                  -= dropped;
+        stats->dropped_time += dropped;
+        stats->num_dropped++;
+    }
+
     phys_data->time_frac = dt;
+    stats->num_steps     = num_steps;
+
+    if (num_steps > 0) {
+        float cost = elapsedMicrosecsSince(time) / (1000000.0f*num_steps);
+
+        if (stats->step_cost == 0.0f)
+            stats->step_cost = cost;
+        else
+            stats->step_cost += (cost - stats->step_cost) * StepCostSmoothing;
+
+        adaptStepRate(phys_data);
+    }
+}
+
+worldT* physicsWorld(const gameSubsystemT* subsystem) {
+    const physicsSubsystemDataT* phys_data = subsystem->data;
+    return (phys_data->world);
+}
+
+float physicsInterpolationAlpha(const gameSubsystemT* subsystem) {
+    const physicsSubsystemDataT* phys_data = subsystem->data;
+
+    // The step size may just have been halved, leaving more than one new step
+    // of time over until the next frame.
+    return (min(phys_data->time_frac / phys_data->time_step, 1.0f));
+}
+
+void physicsSetAdaptiveStepRate(gameSubsystemT* subsystem, bool adaptive) {
+    physicsSubsystemDataT* phys_data = subsystem->data;
+
+    phys_data->adaptive = adaptive;
+
+    if (!adaptive) {
+        phys_data->time_step       = TimeStep;
+        phys_data->stats.time_step = TimeStep;
+    }
+}
+
+void physicsGetStats(const gameSubsystemT* subsystem, physicsStatsT* stats) {
+    const physicsSubsystemDataT* phys_data = subsystem->data;
+
+    *stats = phys_data->stats;
+}
+
+static void cleanupPhysics(gameSubsystemT* subsystem) {
+    physicsSubsystemDataT* phys_data = subsystem->data;
+
+    worldFree(phys_data->world);
+    free(phys_data);
 }
 
 gameSubsystemT* newPhysicsSubsystem(void) {
-    gameSubsystemT* subsystem = newSubsystem("physics");
+    gameSubsystemT* subsystem = newSubsystem("physics", sizeof(physicsComponentDataT));
     physicsSubsystemDataT* phys_data = calloc(1, sizeof(physicsSubsystemDataT));
 
     phys_data->world = worldNew();
 
+    phys_data->time_step        = TimeStep;
+    phys_data->stats.time_step  = TimeStep;
+    phys_data->stats.time_scale = 1.0f;
+
+    // The world steps on the game's worker threads, rather than on a second
+    // set of threads competing with them for the same processors.
+    worldSetJobSystem(phys_data->world, gameJobSystem());
+
     // The physics subsystem is a bit different because all components are
     // actually updated in the after_update_fn, not in each component's update
     // function. This allows us to do collision etc more efficiently.
@@ -64,6 +199,15 @@ gameSubsystemT* newPhysicsSubsystem(void) {
     subsystem->data = phys_data;
     subsystem->after_update_fn = stepWorld;
     subsystem->add_component_fn = addBodyToWorld;
+    subsystem->remove_component_fn = removeBodyFromWorld;
+    subsystem->cleanup_fn = cleanupPhysics;
+    subsystem->runs_jobs = true;
+
+    // Component update functions steer their own bodies, and nothing else.
+    // They still run one at a time, since moving a body by hand also moves
+    // its proxy in the broadphase, which all bodies share (see physics.h).
+    subsystemWrites(subsystem, UpdateStage   , "physics");
+    subsystemWrites(subsystem, ComponentStage, "physics");
 
     return (subsystem);
 }
@@ -8,10 +8,42 @@
 #include "engine/subsystem.h"
 #include "physics/physics.h"
 
+/*------------------------------------------------
+ * TYPES
+ *----------------------------------------------*/
+
+typedef struct {
+    float time_step;    // The current step size, in seconds.
+    float time_scale;   // Simulation time per second of real time.
+    float step_cost;    // Average real time per step, in seconds.
+    int   num_steps;    // The number of steps taken during the last frame.
+    int   num_dropped;  // The number of frames that ran out of steps.
+    float dropped_time; // Simulation time dropped in total, in seconds.
+} physicsStatsT;
+
 /*------------------------------------------------
  * FUNCTIONS
  *----------------------------------------------*/
 
 gameSubsystemT* newPhysicsSubsystem(void);
 
+// Returns the world that the physics components live in, for queries like
+// worldQueryRadius() and worldRaycast().
+worldT* physicsWorld(const gameSubsystemT* subsystem);
+
+// Returns how far the time since the last physics step has come into the next
+// one, from 0 to 1. Bodies should be drawn this far between their previous
+// and current positions (see bodyPrevPosition()).
+float physicsInterpolationAlpha(const gameSubsystemT* subsystem);
+
+// In adaptive mode, the step size is picked from the measured cost of a step,
+// going from 1/120 up to 1/30 seconds when stepping takes too long. Varying
+// the step size makes the simulation depend on the timing, so leave this off
+// when you need reproducible results. Off by default.
+void physicsSetAdaptiveStepRate(gameSubsystemT* subsystem, bool adaptive);
+
+// Gets the step rate counters. dropped_time grows whenever the simulation
+// can't keep up with real time.
+void physicsGetStats(const gameSubsystemT* subsystem, physicsStatsT* stats);
+
 #endif // physicssubsystem_h_